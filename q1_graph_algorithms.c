@@ -1,8 +1,55 @@
+#define _DEFAULT_SOURCE // madvise and MADV_* are not declared under a strict -std=c11
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#include <math.h>
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
 
-#define MAX_NODES 100
+#define INITIAL_NODE_CAPACITY 16
+#define EDGE_SLAB_SIZE 4096 // Edges per arena slab
+#define MAX_WORKER_THREADS 64
+#define DELTA_CHUNK 64                 // Frontier vertices a worker claims at a time
+#define DELTA_PARALLEL_THRESHOLD 1024  // Smaller frontiers are relaxed on the calling thread
+#define APSP_MAGIC "APSP"
+#define APSP_VERSION 1
+#define APSP_HEADER_SIZE (4 + 2 * sizeof(uint32_t)) // Magic, version and node count
+#define APSP_PRINT_LIMIT 12 // Largest matrix echoed to the screen
+#define BATCH_OUTPUT_INITIAL (1 << 20)
+#define CH_MAGIC "CHG1"
+#define CH_VERSION 1
+#define GRAPH_IMAGE_MAGIC "CSRG"
+#define GRAPH_IMAGE_VERSION 1
+#define GRAPH_IMAGE_HAS_COORDINATES 1u // Header flag: x[n] and y[n] follow the weights
+#define CH_WITNESS_SETTLE_LIMIT 256 // Witness searches give up (and keep the shortcut) after this many nodes
+#define CH_BENCHMARK_QUERIES 1000
+#define SHORTEST_PATH_CACHE_SIZE 8
+#define DIAL_MAX_WEIGHT 1024 // Above this largest edge weight the radix heap is picked over Dial's buckets
+#define RADIX_BUCKETS 33     // Keys equal to the last one popped, then one per highest differing bit
+#define BENCH_DEFAULT_NODES 100000
+#define BENCH_EDGES_PER_NODE 8
+#define BENCH_QUADRATIC_LIMIT 20000   // Skip the O(V^2) Dijkstra above this size
+#define BENCH_MAX_WEIGHT 100
+#define MULTI_SOURCE_LANES 16      // Sources searched together by --batch --multi
+#define MULTI_SOURCE_MAX_LANES 64  // One dirty bit per lane in a uint64_t
+#define RELAX_BLOCK_EDGES 256 // Edges per kernel call, also the granularity at which idle blocks are skipped
 
 // ANSI color codes
 #define RESET "\033[0m"
@@ -20,27 +67,443 @@ typedef struct Edge {
     struct Edge* next;
 } Edge;
 
-// Graph structure
+// Fixed-size block of edges handed out by the graph's edge arena
+typedef struct EdgeSlab {
+    struct EdgeSlab* next;
+    Edge edges[EDGE_SLAB_SIZE];
+} EdgeSlab;
+
+// Graph structure: adjacency heads grow on demand and edges are carved out of
+// arena slabs, so resetting the graph never walks the edge lists
 typedef struct Graph {
-    Edge* adjacencyList[MAX_NODES];
+    Edge** adjacencyList;
     int nodeCount;
+    int nodeCapacity;
+    int edgeCount;
+    EdgeSlab* firstSlab;   // Slabs are kept across resets and reused
+    EdgeSlab* currentSlab;
+    int slabUsed;          // Edges already handed out from currentSlab
+    Edge* freeEdges;       // Removed edges, reused before taking new arena space
+    unsigned version;      // Bumped on every change so cached results can be dropped
 } Graph;
 
+// Compressed sparse row snapshot of a Graph: the edges leaving node u are
+// stored in targets/weights[offsets[u] .. offsets[u + 1])
+typedef struct CSRGraph {
+    int nodeCount;
+    int edgeCount;
+    int* offsets;
+    int* targets;
+    int* weights;
+} CSRGraph;
+
+// Indexed binary min-heap over node ids with decrease-key support
+typedef struct IndexedMinHeap {
+    int size;
+    int capacity;
+    int* nodes;    // Heap-ordered node ids
+    int* position; // position[v] = index of v in nodes, or -1 if not queued
+    int* keys;     // keys[v] = current priority of v
+} IndexedMinHeap;
+
+typedef enum MonotoneQueueKind {
+    QUEUE_AUTO, // Dial's buckets when the largest weight is at most DIAL_MAX_WEIGHT, else the radix heap
+    QUEUE_DIAL,
+    QUEUE_RADIX
+} MonotoneQueueKind;
+
+// Integer priority queue for Dijkstra with non-negative integer weights. Keys
+// popped never decrease and every queued key is at most maxWeight above the
+// last one popped. Dial's variant keeps maxWeight + 1 circular buckets of
+// intrusive node lists; the radix heap buckets (key, node) entries by the
+// highest bit in which the key differs from the last key popped and leaves
+// entries stale on decrease-key.
+typedef struct MonotoneQueue {
+    MonotoneQueueKind kind;
+    int size;                           // Nodes queued
+    unsigned* keys;                     // keys[v] = current key of v, or UINT_MAX if not queued
+    int bucketCount;                    // Dial's buckets
+    int cursor;
+    int* bucketHead;
+    int* next;
+    int* previous;
+    unsigned last;                      // Radix heap: last key popped
+    uint64_t* entries[RADIX_BUCKETS];   // key << 32 | node
+    int entryCount[RADIX_BUCKETS];
+    int entryCapacity[RADIX_BUCKETS];
+} MonotoneQueue;
+
+// Growable array of ints
+typedef struct IntVector {
+    int* data;
+    int size;
+    int capacity;
+} IntVector;
+
+// Task run by every pool worker; worker is 0..workerCount-1
+typedef void (*PoolTask)(void* arg, int worker);
+
+// Fixed set of worker threads that all run the same task per round. The
+// calling thread acts as worker 0, so a pool of one worker spawns no threads.
+typedef struct ThreadPool {
+    pthread_t* threads;
+    int workerCount;
+    pthread_mutex_t lock;
+    pthread_cond_t startRound;
+    pthread_cond_t roundDone;
+    PoolTask task;
+    void* arg;
+    int generation; // Bumped for every round handed to the workers
+    int pending;    // Workers still running the current round
+    int shuttingDown;
+} ThreadPool;
+
+// Per-worker range of sources for Johnson's algorithm. The owner and thieves
+// both claim sources with an atomic increment of next, so each source is
+// handed out exactly once; padding keeps queues on separate cache lines.
+typedef struct StealQueue {
+    int next;
+    int end;
+    char padding[56];
+} StealQueue;
+
+// Read-only memory mapping of a whole file. Pipes and other files that
+// can't be mapped are read into a heap buffer instead (copied is set).
+typedef struct MappedFile {
+    const char* data;
+    size_t size;
+    int copied;
+} MappedFile;
+
+// Growable byte buffer used to batch output into a single write
+typedef struct CharBuffer {
+    char* data;
+    size_t size;
+    size_t capacity;
+} CharBuffer;
+
+// Scratch space for repeated single-pair searches. Distances are only valid
+// for nodes whose stamp equals currentStamp, so starting a new search is O(1)
+// instead of clearing arrays sized to the whole graph.
+typedef struct SearchSpace {
+    int nodeCount;
+    int* distances;
+    int* prev;
+    unsigned* stamp;
+    unsigned currentStamp;
+    IndexedMinHeap* heap;
+} SearchSpace;
+
+// Estimate of the remaining distance from node to target; must never overestimate
+typedef int (*Heuristic)(int node, int target, const void* context);
+
+// Planar node coordinates for the Euclidean A* heuristic. The estimate is
+// scale * straight-line distance, admissible as long as no edge is cheaper
+// than scale times the length of the segment it spans. Nodes without a
+// known position hold NaN and get an estimate of 0.
+typedef struct Coordinates {
+    int nodeCount;
+    double* x;
+    double* y;
+    double scale;
+} Coordinates;
+
+// Graph image mapped read-only: csr and coordinates point into the mapping
+// and must not be freed or written to. Close with closeGraphImage.
+typedef struct MappedGraph {
+    MappedFile file;
+    CSRGraph csr;
+    Coordinates coordinates;
+    int hasCoordinates;
+} MappedGraph;
+
+// Arc in the graph being contracted; middle is the node a shortcut bypasses
+typedef struct CHArc {
+    int node;
+    int weight;
+    int middle;
+} CHArc;
+
+typedef struct CHArcList {
+    CHArc* arcs;
+    int size;
+    int capacity;
+} CHArcList;
+
+// Contraction hierarchy. upward holds arcs u -> w with rank[w] > rank[u];
+// downward holds, at x, every arc y -> x with rank[y] > rank[x] (as target y),
+// i.e. the upward graph of the backward search. Each arc records the middle
+// node it shortcuts, or -1 for an original edge.
+typedef struct ContractionHierarchy {
+    int nodeCount;
+    int* rank;
+    CSRGraph upward;
+    CSRGraph downward;
+    int* upwardMiddle;
+    int* downwardMiddle;
+} ContractionHierarchy;
+
+// Shortest-path tree from one source kept up to date while edges change. The
+// tree keeps parent, first-child and sibling links so the subtree below a
+// changed edge can be walked without scanning every node, and a reverse copy
+// of the graph gives each node's incoming edges.
+typedef struct DynamicShortestPaths {
+    Graph* graph;
+    Graph reverse;
+    int source;
+    int nodeCount;
+    int* distances;
+    int* prev;
+    int* firstChild;
+    int* nextSibling;
+    int* prevSibling;
+    int* stamp;           // Marks nodes of the subtree being repaired
+    int currentStamp;
+    IndexedMinHeap* heap;
+    IntVector changed;    // Nodes whose distance moved in the last update
+} DynamicShortestPaths;
+
+// Distances and predecessors computed from one source
+typedef struct ShortestPathTree {
+    int source;
+    int nodeCount;
+    int* distances;
+    int* prev;
+} ShortestPathTree;
+
+// Algorithms whose trees can be cached; results are kept apart per algorithm
+// because equal-length paths may be broken differently
+typedef enum ShortestPathAlgorithm {
+    SPT_DIJKSTRA,
+    SPT_BELLMAN_FORD,
+    SPT_DIJKSTRA_HEAP,
+    SPT_QUEUE_BELLMAN_FORD
+} ShortestPathAlgorithm;
+
+typedef struct TreeCacheEntry {
+    ShortestPathAlgorithm algorithm;
+    ShortestPathTree* tree;
+    unsigned long long lastUsed;
+} TreeCacheEntry;
+
+// Least-recently-used cache of shortest-path trees keyed by (algorithm,
+// source). Every entry belongs to one version of one graph; any change to the
+// graph empties the cache on the next lookup.
+typedef struct ShortestPathCache {
+    TreeCacheEntry entries[SHORTEST_PATH_CACHE_SIZE];
+    int size;
+    unsigned long long clock;
+    const Graph* graph;
+    unsigned graphVersion;
+    int hits;
+    int misses;
+} ShortestPathCache;
+
+// Vertex renumbering applied before running the CSR algorithms
+typedef enum VertexOrdering {
+    ORDER_NONE,
+    ORDER_BFS,     // Breadth-first from low-degree vertices
+    ORDER_RCM,     // Reverse Cuthill-McKee: BFS with neighbours by degree, reversed
+    ORDER_DEGREE,  // Highest total degree first, so hubs share cache lines
+    ORDER_RANDOM   // Fixed-seed shuffle, to mimic arbitrarily numbered input
+} VertexOrdering;
+
+// A CSR copy under a new numbering plus the maps between old and new ids
+typedef struct ReorderedGraph {
+    CSRGraph csr;
+    int* newId;
+    int* oldId;
+} ReorderedGraph;
+
+// Computes candidates[k] = distances[sources[k]] + weights[k] for a run of
+// edges, or INT_MAX where the source is still unreached
+typedef void (*RelaxKernel)(const int* sources, const int* weights, const int* distances,
+                            int* candidates, int count);
+
+// Relaxes one edge for all K lanes: target[k] = min(target[k], from[k] + weight).
+// Returns the smallest lane value that improved (INT_MAX if none did) and sets
+// the bits of the improved lanes in *improvedLanes.
+typedef int (*LaneKernel)(const int* from, int* target, int weight, int laneCount, uint64_t* improvedLanes);
+
+// Per-run instrumentation, compiled in only with -DQ1_COUNTERS. Each thread
+// counts into its own RunCounters; an instrumented run resets them with
+// COUNTERS_BEGIN, closes timed phases with COUNTERS_PHASE and writes one JSON
+// line with COUNTERS_END. Without the flag every macro expands to nothing.
+#ifdef Q1_COUNTERS
+typedef struct RunCounters {
+    const char* algorithm;
+    int source;
+    int nodeCount;
+    int edgeCount;
+    long long relaxations;   // Edges examined
+    long long improvements;  // Edges that lowered a distance
+    long long heapPushes;
+    long long heapDecreases;
+    long long heapPops;
+    long long scans;         // Vertices settled or dequeued
+    long long passes;        // Full Bellman-Ford passes
+    double started;
+    double phaseStarted;
+    double setupSeconds;     // Building CSR snapshots
+    double scanSeconds;      // Negative-weight scan
+    double mainSeconds;
+} RunCounters;
+
+static __thread RunCounters runCounters;
+
+void countersBegin(const char* algorithm, int source, int nodeCount, int edgeCount);
+void countersPhase(double* phaseSeconds);
+void countersEnd(const char* outcome);
+
+#define COUNT(field) (runCounters.field++)
+#define COUNT_ADD(field, amount) (runCounters.field += (amount))
+#define COUNTERS_BEGIN(algorithm, source, nodeCount, edgeCount) countersBegin(algorithm, source, nodeCount, edgeCount)
+#define COUNTERS_PHASE(phase) countersPhase(&runCounters.phase)
+#define COUNTERS_END(outcome) countersEnd(outcome)
+#else
+#define COUNT(field) ((void)0)
+#define COUNT_ADD(field, amount) ((void)0)
+#define COUNTERS_BEGIN(algorithm, source, nodeCount, edgeCount) ((void)0)
+#define COUNTERS_PHASE(phase) ((void)0)
+#define COUNTERS_END(outcome) ((void)0)
+#endif
+
 // Function prototypes
 void initGraph(Graph* graph, int nodes);
+void ensureNodeCapacity(Graph* graph, int nodes);
+void resetGraph(Graph* graph);
 void addEdge(Graph* graph, int u, int v, int weight);
-void dijkstra(Graph* graph, int source);
-void bellmanFord(Graph* graph, int source);
+int removeEdge(Graph* graph, int u, int v);
+Edge* findEdge(Graph* graph, int u, int v);
+int dijkstraDistances(Graph* graph, int source, int* distances, int* prev);
+void dijkstra(Graph* graph, int source, ShortestPathCache* cache);
+int bellmanFordDistances(Graph* graph, int source, int* distances, int* prev);
+void bellmanFord(Graph* graph, int source, ShortestPathCache* cache);
+void buildCSR(Graph* graph, CSRGraph* csr);
+void freeCSR(CSRGraph* csr);
+IndexedMinHeap* createIndexedMinHeap(int capacity);
+void heapPushOrDecrease(IndexedMinHeap* heap, int node, int key);
+int heapPopMin(IndexedMinHeap* heap);
+void freeIndexedMinHeap(IndexedMinHeap* heap);
+void dijkstraHeapDistances(const CSRGraph* csr, int source, int* distances, int* prev, IndexedMinHeap* heap);
+void dijkstraHeap(Graph* graph, int source, ShortestPathCache* cache);
+int maxEdgeWeight(const CSRGraph* csr);
+MonotoneQueue* createMonotoneQueue(int nodeCount, int maxWeight, MonotoneQueueKind kind);
+void monotonePushOrDecrease(MonotoneQueue* queue, int node, int key);
+int monotonePopMin(MonotoneQueue* queue);
+void freeMonotoneQueue(MonotoneQueue* queue);
+void dijkstraMonotoneDistances(const CSRGraph* csr, int source, int* distances, int* prev, MonotoneQueue* queue);
+int findPredecessorCycle(const int* prev, int nodeCount, int* cycle);
+int spfaDistances(const CSRGraph* csr, int source, int* distances, int* prev, int* cycle);
+void bellmanFordQueue(Graph* graph, int source, ShortestPathCache* cache);
+void intVectorPush(IntVector* vector, int value);
+int availableCores();
+ThreadPool* createThreadPool(int workerCount);
+void threadPoolRun(ThreadPool* pool, PoolTask task, void* arg);
+void freeThreadPool(ThreadPool* pool);
+void deltaSteppingDistances(const CSRGraph* csr, int source, int delta, int* distances, int* prev, ThreadPool* pool);
+int defaultDeltaWidth(const CSRGraph* csr);
+void deltaStepping(Graph* graph, int source);
+int johnsonAllPairs(Graph* graph, const char* outputPath, ThreadPool* pool);
+void allPairsShortestPaths(Graph* graph);
+void heapClear(IndexedMinHeap* heap);
+void buildReverseCSR(const CSRGraph* csr, CSRGraph* reverse);
+SearchSpace* createSearchSpace(int nodeCount);
+void freeSearchSpace(SearchSpace* space);
+int dijkstraToTarget(const CSRGraph* csr, int source, int target, SearchSpace* space, int* settled);
+int astarToTarget(const CSRGraph* csr, int source, int target, Heuristic heuristic, const void* context,
+                  SearchSpace* space, int* settled);
+int bidirectionalDijkstra(const CSRGraph* csr, const CSRGraph* reverse, int source, int target,
+                          SearchSpace* forward, SearchSpace* backward, int* meeting, int* settled);
+int tracePath(const SearchSpace* space, int target, int* path);
+int traceBidirectionalPath(const SearchSpace* forward, const SearchSpace* backward, int meeting, int* path);
+int loadCoordinates(const char* path, int nodeCount, Coordinates* coordinates, int* errorLine);
+void freeCoordinates(Coordinates* coordinates);
+void printCoordinatesError(FILE* stream, const char* path, int errorLine);
+int euclideanHeuristic(int node, int target, const void* context);
+void pointToPointQuery(Graph* graph, int source);
+void buildContractionHierarchy(const CSRGraph* csr, ContractionHierarchy* ch);
+void freeContractionHierarchy(ContractionHierarchy* ch);
+int saveContractionHierarchy(const ContractionHierarchy* ch, const char* path);
+int loadContractionHierarchy(const char* path, ContractionHierarchy* ch);
+int hierarchyQuery(const ContractionHierarchy* ch, int source, int target,
+                   SearchSpace* forward, SearchSpace* backward, int* meeting);
+int hierarchyPath(const ContractionHierarchy* ch, const SearchSpace* forward, const SearchSpace* backward,
+                  int meeting, int* path);
+void contractionHierarchyMenu(Graph* graph, int source);
+DynamicShortestPaths* createDynamicShortestPaths(Graph* graph, int source);
+void freeDynamicShortestPaths(DynamicShortestPaths* dsp);
+int dynamicInsertEdge(DynamicShortestPaths* dsp, int u, int v, int weight);
+int dynamicDeleteEdge(DynamicShortestPaths* dsp, int u, int v);
+int dynamicSetWeight(DynamicShortestPaths* dsp, int u, int v, int weight);
+void dynamicUpdatesMenu(Graph* graph, int source);
+ShortestPathTree* createShortestPathTree(int source, int nodeCount);
+void freeShortestPathTree(ShortestPathTree* tree);
+int shortestPathTo(const ShortestPathTree* tree, int target, int* path);
+void initShortestPathCache(ShortestPathCache* cache);
+ShortestPathTree* cacheLookup(ShortestPathCache* cache, const Graph* graph, ShortestPathAlgorithm algorithm, int source);
+ShortestPathTree* cacheInsert(ShortestPathCache* cache, const Graph* graph, ShortestPathAlgorithm algorithm,
+                              ShortestPathTree* tree);
+void clearShortestPathCache(ShortestPathCache* cache);
+void pathToTarget(Graph* graph, int source, ShortestPathCache* cache);
+void printShortestPaths(const char* color, const char* algorithmName, int source,
+                        const int* distances, const int* prev, int nodeCount);
+void algorithmMenu(Graph* graph, int source);
 void freeGraph(Graph* graph);
 void printDivider();
 int isValidNode(int node, int maxNodes);
 void printSampleGraph();
 void promptUserForGraph(Graph* graph);
+double nowSeconds();
+int mapFile(const char* path, MappedFile* file);
+void unmapFile(MappedFile* file);
+int* parseIntegers(const char* data, size_t size, int* count, int* errorLine);
+int buildCSRFromTriples(const int* triples, int edgeCount, CSRGraph* csr);
+int loadEdgeList(const char* path, int binary, CSRGraph* csr);
+int saveGraphImage(const CSRGraph* csr, const Coordinates* coordinates, const char* path);
+int openGraphImage(const char* path, MappedGraph* graph);
+void closeGraphImage(MappedGraph* graph);
+int runConvertMode(int argc, char** argv);
+int* loadQueryPairs(const char* path, int* queryCount);
+void writeBatchAnswers(const int* pairs, int queryCount, const int* answers, const char* answerValid);
+int runBatchMode(int argc, char** argv);
+int runBuildHierarchyMode(int argc, char** argv);
+int runHierarchyQueryMode(int argc, char** argv);
+uint64_t nextRandom(uint64_t* state);
+void generateRandomGraph(Graph* graph, int nodes, int edgesPerNode, uint64_t seed);
+void generateGridGraph(Graph* graph, int nodes, uint64_t seed);
+void generateRmatGraph(Graph* graph, int nodes, int edgesPerNode, uint64_t seed);
+void generateRoadGraph(Graph* graph, int nodes, uint64_t seed);
+int generateGraph(Graph* graph, const char* kind, int nodes, uint64_t seed);
+int runGenerateMode(int argc, char** argv);
+int runBenchmarkMode(int argc, char** argv);
+int parseVertexOrdering(const char* name, VertexOrdering* ordering);
+int* computeVertexOrder(const CSRGraph* csr, VertexOrdering ordering);
+void reorderCSR(const CSRGraph* csr, VertexOrdering ordering, ReorderedGraph* reordered);
+void freeReorderedGraph(ReorderedGraph* reordered);
+void restoreOriginalOrder(const ReorderedGraph* reordered, const int* distances, const int* prev,
+                          int* originalDistances, int* originalPrev);
+void graphFromCSR(const CSRGraph* csr, Graph* graph);
+int openCacheMissCounter();
+long long readCacheMissCounter(int counter);
+RelaxKernel selectRelaxKernel(int allowSimd, const char** name);
+int bellmanFordEdgeArray(const CSRGraph* incoming, int source, int* distances, int* prev, RelaxKernel kernel);
+LaneKernel selectLaneKernel(int allowSimd, const char** name);
+int multiSourceDistances(const CSRGraph* csr, const int* sources, int sourceCount, int* matrix, LaneKernel kernel);
 
-int main() {
-    Graph graph;
+int main(int argc, char** argv) {
+    Graph graph = {0};
     int choice;
 
+    if (argc > 1) {
+        if (strcmp(argv[1], "--build-ch") == 0) return runBuildHierarchyMode(argc, argv);
+        if (strcmp(argv[1], "--ch-query") == 0) return runHierarchyQueryMode(argc, argv);
+        if (strcmp(argv[1], "--generate") == 0) return runGenerateMode(argc, argv);
+        if (strcmp(argv[1], "--bench") == 0) return runBenchmarkMode(argc, argv);
+        if (strcmp(argv[1], "--convert") == 0) return runConvertMode(argc, argv);
+        return runBatchMode(argc, argv);
+    }
+
     printDivider();
     printf(MAGENTA "\nWelcome to the Weighted Graph \nAlgorithm Visualizer!\n" RESET);
     printDivider();
@@ -88,33 +551,7 @@ int main() {
                 continue;
             }
 
-// Algorithm selection loop with changing source option
-            while (1) {
-                printf(BLUE "Choose the algorithm:\n" RESET);
-                printf("1. Dijkstra's Algorithm\n");
-                printf("2. Bellman-Ford Algorithm\n");
-                printf("3. Change Source Node\n");
-                printf("4. Go back to main menu\n");
-                printf(BLUE "Enter your choice (1, 2, 3, or 4): " RESET);
-                scanf("%d", &choice);
-
-                if (choice == 1) {
-                    dijkstra(&graph, source);
-                } else if (choice == 2) {
-                    bellmanFord(&graph, source);
-                } else if (choice == 3) {
-                    printf(BLUE "Enter new source node (0-4): " RESET);
-                    scanf("%d", &source);
-                    if (!isValidNode(source, graph.nodeCount)) {
-                        printf(RED "Invalid source node.\n" RESET);
-                        continue;
-                    }
-                } else if (choice == 4) {
-                    break; // Go back to main menu
-                } else {
-                    printf(RED "Invalid choice of algorithm.\n" RESET);
-                }
-            }
+            algorithmMenu(&graph, source);
         } else if (choice == 3) {
             printf(GREEN "Exiting the program. Goodbye!\n" RESET);
             break; // Exit the loop
@@ -127,43 +564,149 @@ int main() {
     return 0;
 }
 
+// Prepare an empty graph with the given number of nodes. The graph must be
+// zero-initialized or previously initialized; existing edges are discarded.
 void initGraph(Graph* graph, int nodes) {
+    resetGraph(graph);
+    ensureNodeCapacity(graph, nodes);
     graph->nodeCount = nodes;
-    for (int i = 0; i < nodes; i++) {
-        graph->adjacencyList[i] = NULL;
+}
+
+// Grow the adjacency head array so node ids 0..nodes-1 are addressable
+void ensureNodeCapacity(Graph* graph, int nodes) {
+    if (nodes <= graph->nodeCapacity) return;
+
+    int capacity = graph->nodeCapacity > 0 ? graph->nodeCapacity : INITIAL_NODE_CAPACITY;
+    while (capacity < nodes) {
+        capacity = capacity > INT_MAX / 2 ? nodes : capacity * 2;
+    }
+
+    Edge** list = (Edge**)realloc(graph->adjacencyList, (size_t)capacity * sizeof(Edge*));
+    if (!list) {
+        printf(RED "Out of memory growing the graph to %d nodes.\n" RESET, nodes);
+        exit(EXIT_FAILURE);
+    }
+    memset(list + graph->nodeCapacity, 0, (size_t)(capacity - graph->nodeCapacity) * sizeof(Edge*));
+    graph->adjacencyList = list;
+    graph->nodeCapacity = capacity;
+}
+
+// Drop every edge by rewinding the arena; slabs stay allocated for reuse
+void resetGraph(Graph* graph) {
+    if (graph->nodeCount > 0) {
+        memset(graph->adjacencyList, 0, (size_t)graph->nodeCount * sizeof(Edge*));
+    }
+    graph->nodeCount = 0;
+    graph->edgeCount = 0;
+    graph->currentSlab = graph->firstSlab;
+    graph->slabUsed = 0;
+    graph->freeEdges = NULL;
+    graph->version++;
+}
+
+// Hand out one edge from the arena, moving to (or allocating) the next slab
+static Edge* allocateEdge(Graph* graph) {
+    if (graph->freeEdges != NULL) {
+        Edge* edge = graph->freeEdges;
+        graph->freeEdges = edge->next;
+        return edge;
+    }
+    if (graph->currentSlab == NULL || graph->slabUsed == EDGE_SLAB_SIZE) {
+        EdgeSlab* next = graph->currentSlab ? graph->currentSlab->next : graph->firstSlab;
+        if (next == NULL) {
+            next = (EdgeSlab*)malloc(sizeof(EdgeSlab));
+            if (!next) {
+                printf(RED "Out of memory allocating graph edges.\n" RESET);
+                exit(EXIT_FAILURE);
+            }
+            next->next = NULL;
+            if (graph->currentSlab) {
+                graph->currentSlab->next = next;
+            } else {
+                graph->firstSlab = next;
+            }
+        }
+        graph->currentSlab = next;
+        graph->slabUsed = 0;
     }
+    return &graph->currentSlab->edges[graph->slabUsed++];
 }
 
+// Add a directed edge u -> v, growing the node count if either end is new
 void addEdge(Graph* graph, int u, int v, int weight) {
-    Edge* newEdge = (Edge*)malloc(sizeof(Edge));
+    int needed = (u > v ? u : v) + 1;
+    if (needed > graph->nodeCount) {
+        ensureNodeCapacity(graph, needed);
+        graph->nodeCount = needed;
+    }
+
+    Edge* newEdge = allocateEdge(graph);
     newEdge->destination = v;
     newEdge->weight = weight;
     newEdge->next = graph->adjacencyList[u];
     graph->adjacencyList[u] = newEdge;
+    graph->edgeCount++;
+    graph->version++;
 }
 
-void dijkstra(Graph* graph, int source) {
-    int distances[MAX_NODES];
-    int visited[MAX_NODES] = {0};
-    int prev[MAX_NODES] = {-1};
-
-    for (int i = 0; i < graph->nodeCount; i++) {
-        distances[i] = INT_MAX;
+// Link pointing at the first edge u -> v (with the given weight unless weight
+// is NULL), or NULL if there is none
+static Edge** findEdgeLink(Graph* graph, int u, int v, const int* weight) {
+    for (Edge** link = &graph->adjacencyList[u]; *link != NULL; link = &(*link)->next) {
+        if ((*link)->destination == v && (weight == NULL || (*link)->weight == *weight)) {
+            return link;
+        }
     }
+    return NULL;
+}
 
-    distances[source] = 0; // Start from the chosen source node
+static void unlinkEdge(Graph* graph, Edge** link) {
+    Edge* edge = *link;
+    *link = edge->next;
+    edge->next = graph->freeEdges;
+    graph->freeEdges = edge;
+    graph->edgeCount--;
+    graph->version++;
+}
+
+// Remove the first edge u -> v. Returns 1 if an edge was removed.
+int removeEdge(Graph* graph, int u, int v) {
+    Edge** link = findEdgeLink(graph, u, v, NULL);
+    if (link == NULL) return 0;
+    unlinkEdge(graph, link);
+    return 1;
+}
 
+// Find the first edge u -> v, or NULL
+Edge* findEdge(Graph* graph, int u, int v) {
+    Edge** link = findEdgeLink(graph, u, v, NULL);
+    return link != NULL ? *link : NULL;
+}
+
+// O(V^2) Dijkstra over the linked adjacency lists. Returns 0 without touching
+// the output arrays if the graph has a negative edge.
+int dijkstraDistances(Graph* graph, int source, int* distances, int* prev) {
     // Check for negative weights in the graph
     for (int i = 0; i < graph->nodeCount; i++) {
         Edge* edge = graph->adjacencyList[i];
         while (edge != NULL) {
             if (edge->weight < 0) {
-                printf(RED "Negative weight found. Dijkstra's algorithm can't work with negative weights.\n" RESET);
-                return;
+                COUNTERS_PHASE(scanSeconds);
+                return 0;
             }
             edge = edge->next;
         }
     }
+    COUNTERS_PHASE(scanSeconds);
+
+    int* visited = (int*)calloc((unsigned)graph->nodeCount, sizeof(int));
+
+    for (int i = 0; i < graph->nodeCount; i++) {
+        distances[i] = INT_MAX;
+        prev[i] = -1;
+    }
+
+    distances[source] = 0; // Start from the chosen source node
 
     for (int count = 0; count < graph->nodeCount - 1; count++) {
         int minDistance = INT_MAX;
@@ -179,12 +722,15 @@ void dijkstra(Graph* graph, int source) {
         if (minIndex == -1) break; // No more reachable nodes
 
         visited[minIndex] = 1;
+        COUNT(scans);
 
         Edge* edge = graph->adjacencyList[minIndex];
         while (edge != NULL) {
+            COUNT(relaxations);
             if (!visited[edge->destination] && 
                 distances[minIndex] != INT_MAX && 
                 distances[minIndex] + edge->weight < distances[edge->destination]) {
+                COUNT(improvements);
                 distances[edge->destination] = distances[minIndex] + edge->weight;
                 prev[edge->destination] = minIndex; // Store the previous node for path
             }
@@ -192,215 +738,4480 @@ void dijkstra(Graph* graph, int source) {
         }
     }
 
-    printDivider();
-    printf(GREEN "Dijkstra's shortest paths from node %d (source):\n" RESET, source);
-    printf("Vertex\tDistance from Source\tPath\n");
-    for (int i = 0; i < graph->nodeCount; i++) {
-        printf("%d\t\t", i);
-        if (distances[i] == INT_MAX) {
-            printf("Unreachable\t\t");
-        } else {
-            printf("%d\t\t\t", distances[i]);
-        }
-
-        // Print the path
-        if (distances[i] != INT_MAX) {
-            printf("Path: ");
-            int j = i;
-            // Print the path in reverse
-            if (prev[j] != -1) {
-                while (j != -1) {
-                    printf("%d", j);
-                    j = prev[j];
-                    if (j != -1) {
-                        printf(" <- ");
-                    }
-                }
-            } else {
-                printf("%d", source); // If source is the only node
+    free(visited);
+    COUNTERS_PHASE(mainSeconds);
+    return 1;
+}
+
+void dijkstra(Graph* graph, int source, ShortestPathCache* cache) {
+    ShortestPathTree* tree = cacheLookup(cache, graph, SPT_DIJKSTRA, source);
+    if (tree == NULL) {
+        COUNTERS_BEGIN("dijkstra", source, graph->nodeCount, graph->edgeCount);
+        CSRGraph csr;
+        buildCSR(graph, &csr);
+        COUNTERS_PHASE(setupSeconds);
+
+        // Check for negative weights in the graph
+        for (int k = 0; k < csr.edgeCount; k++) {
+            if (csr.weights[k] < 0) {
+                COUNTERS_PHASE(scanSeconds);
+                COUNTERS_END("negative_weight");
+                printf(RED "Negative weight found. Dijkstra's algorithm can't work with negative weights.\n" RESET);
+                freeCSR(&csr);
+                return;
             }
-            printf("\n");
-        } else {
-            printf("No path\n");
         }
+        COUNTERS_PHASE(scanSeconds);
+
+        // Integer weights: a bucket queue chosen by the largest weight
+        tree = createShortestPathTree(source, csr.nodeCount);
+        MonotoneQueue* queue = createMonotoneQueue(csr.nodeCount, maxEdgeWeight(&csr), QUEUE_AUTO);
+        dijkstraMonotoneDistances(&csr, source, tree->distances, tree->prev, queue);
+        COUNTERS_PHASE(mainSeconds);
+        COUNTERS_END("ok");
+        freeMonotoneQueue(queue);
+        freeCSR(&csr);
+        tree = cacheInsert(cache, graph, SPT_DIJKSTRA, tree);
     }
-    printDivider();
+    printShortestPaths(GREEN, "Dijkstra's", source, tree->distances, tree->prev, tree->nodeCount);
 }
-void bellmanFord(Graph* graph, int source) {
-    int distances[MAX_NODES];
-    int prev[MAX_NODES];
 
+// Bellman-Ford over the linked adjacency lists, stopping after a pass that
+// changes nothing. Returns 0 if a negative cycle is reachable from source.
+int bellmanFordDistances(Graph* graph, int source, int* distances, int* prev) {
     for (int i = 0; i < graph->nodeCount; i++) {
         distances[i] = INT_MAX;
         prev[i] = -1;
     }
     distances[source] = 0;
 
-    for (int i = 1; i < graph->nodeCount; i++) {
+    int changed = 1;
+    for (int i = 1; i < graph->nodeCount && changed; i++) {
+        changed = 0;
+        COUNT(passes);
         for (int u = 0; u < graph->nodeCount; u++) {
             Edge* edge = graph->adjacencyList[u];
             while (edge != NULL) {
+                COUNT(relaxations);
                 if (distances[u] != INT_MAX && 
                     distances[u] + edge->weight < distances[edge->destination]) {
+                    COUNT(improvements);
                     distances[edge->destination] = distances[u] + edge->weight;
                     prev[edge->destination] = u; // Track path
+                    changed = 1;
                 }
                 edge = edge->next;
             }
         }
     }
 
-    // Check for negative weight cycles
-    for (int u = 0; u < graph->nodeCount; u++) {
+    // Check for negative weight cycles (only possible if the last pass still changed something)
+    for (int u = 0; changed && u < graph->nodeCount; u++) {
         Edge* edge = graph->adjacencyList[u];
         while (edge != NULL) {
             if (distances[u] != INT_MAX && 
                 distances[u] + edge->weight < distances[edge->destination]) {
-                printf(RED "Graph contains a negative weight cycle.\n" RESET);
-                return;
+                return 0;
             }
             edge = edge->next;
         }
     }
+    return 1;
+}
 
-    printDivider();
-    printf(CYAN "Bellman-Ford shortest paths from node %d (source):\n" RESET, source);
-    printf("Vertex\tDistance from Source\tPath\n");
-    for (int i = 0; i < graph->nodeCount; i++) {
-        printf("%d\t\t", i);
-        if (distances[i] == INT_MAX) {
-            printf("Unreachable\t\t");
-        } else {
-            printf("%d\t\t\t", distances[i]);
-        }
+void bellmanFord(Graph* graph, int source, ShortestPathCache* cache) {
+    ShortestPathTree* tree = cacheLookup(cache, graph, SPT_BELLMAN_FORD, source);
+    if (tree == NULL) {
+        COUNTERS_BEGIN("bellman_ford", source, graph->nodeCount, graph->edgeCount);
+        CSRGraph csr, incoming;
+        buildCSR(graph, &csr);
+        buildReverseCSR(&csr, &incoming);
+        freeCSR(&csr);
 
-        // Print the path
-        int j = i;
-        if (distances[i] != INT_MAX) {
-            printf("Path: ");
-            while (prev[j] != -1) {
-                printf("%d <- ", j);
-                j = prev[j];
-            }
-            printf("%d\n", source);
-        } else {
-            printf("No path\n");
+        const char* kernelName;
+        tree = createShortestPathTree(source, graph->nodeCount);
+        COUNTERS_PHASE(setupSeconds);
+        int ok = bellmanFordEdgeArray(&incoming, source, tree->distances, tree->prev, selectRelaxKernel(1, &kernelName));
+        COUNTERS_PHASE(mainSeconds);
+        COUNTERS_END(ok ? "ok" : "negative_cycle");
+        freeCSR(&incoming);
+        if (!ok) {
+            printf(RED "Graph contains a negative weight cycle.\n" RESET);
+            freeShortestPathTree(tree);
+            return;
         }
+        tree = cacheInsert(cache, graph, SPT_BELLMAN_FORD, tree);
     }
-    printDivider();
+    printShortestPaths(CYAN, "Bellman-Ford", source, tree->distances, tree->prev, tree->nodeCount);
 }
 
-void freeGraph(Graph* graph) {
-    for (int i = 0; i < graph->nodeCount; i++) {
-        Edge* edge = graph->adjacencyList[i];
-        while (edge != NULL) {
-            Edge* temp = edge;
-            edge = edge->next;
-            free(temp);
+// Snapshot the linked adjacency lists into contiguous CSR arrays
+void buildCSR(Graph* graph, CSRGraph* csr) {
+    int n = graph->nodeCount;
+    csr->nodeCount = n;
+    csr->offsets = (int*)malloc((n + 1) * sizeof(int));
+
+    csr->offsets[0] = 0;
+    for (int u = 0; u < n; u++) {
+        int degree = 0;
+        for (Edge* edge = graph->adjacencyList[u]; edge != NULL; edge = edge->next) {
+            degree++;
+        }
+        csr->offsets[u + 1] = csr->offsets[u] + degree;
+    }
+
+    csr->edgeCount = csr->offsets[n];
+    csr->targets = (int*)malloc((csr->edgeCount > 0 ? csr->edgeCount : 1) * sizeof(int));
+    csr->weights = (int*)malloc((csr->edgeCount > 0 ? csr->edgeCount : 1) * sizeof(int));
+
+    for (int u = 0; u < n; u++) {
+        int k = csr->offsets[u];
+        for (Edge* edge = graph->adjacencyList[u]; edge != NULL; edge = edge->next) {
+            csr->targets[k] = edge->destination;
+            csr->weights[k] = edge->weight;
+            k++;
         }
     }
 }
 
-void printDivider() {
-    printf(YELLOW "--------------------------------------\n" RESET);
+void freeCSR(CSRGraph* csr) {
+    free(csr->offsets);
+    free(csr->targets);
+    free(csr->weights);
+    csr->offsets = csr->targets = csr->weights = NULL;
+    csr->nodeCount = csr->edgeCount = 0;
 }
 
-int isValidNode(int node, int maxNodes) {
-    return node >= 0 && node < maxNodes;
+// Create an empty indexed heap able to hold node ids 0..capacity-1
+IndexedMinHeap* createIndexedMinHeap(int capacity) {
+    IndexedMinHeap* heap = (IndexedMinHeap*)malloc(sizeof(IndexedMinHeap));
+    heap->size = 0;
+    heap->capacity = capacity;
+    heap->nodes = (int*)malloc(capacity * sizeof(int));
+    heap->position = (int*)malloc(capacity * sizeof(int));
+    heap->keys = (int*)malloc(capacity * sizeof(int));
+    for (int i = 0; i < capacity; i++) {
+        heap->position[i] = -1;
+    }
+    return heap;
 }
 
-void printSampleGraph() {
-    printf(MAGENTA "Sample Graph (5 nodes: 0-1-2-3-4)\n" RESET);
-    printf("       Edges:\n");
-    printf("0 -> 1 (10)\n");
-    printf("0 -> 3 (5)\n");
-    printf("1 -> 2 (1)\n");
-    printf("2 -> 4 (4)\n");
-    printf("3 -> 1 (3)\n");
-    printf("3 -> 2 (9)\n");
-    printf("3 -> 4 (2)\n");
-    printf("4 -> 0 (7)\n");
-    printf("4 -> 2 (-2)\n");
-    printDivider();
+static void heapSiftUp(IndexedMinHeap* heap, int i) {
+    int node = heap->nodes[i];
+    int key = heap->keys[node];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        int parentNode = heap->nodes[parent];
+        if (heap->keys[parentNode] <= key) break;
+        heap->nodes[i] = parentNode;
+        heap->position[parentNode] = i;
+        i = parent;
+    }
+    heap->nodes[i] = node;
+    heap->position[node] = i;
 }
-void promptUserForGraph(Graph* graph) {
-    int nodes, edges, u, v, weight;
 
-    printf(BLUE "Enter the number of nodes (max %d): " RESET, MAX_NODES);
-    scanf("%d", &nodes);
-    if (!isValidNode(nodes, MAX_NODES)) {
-        printf(RED "Invalid number of nodes.\n" RESET);
-        return;
+static void heapSiftDown(IndexedMinHeap* heap, int i) {
+    int node = heap->nodes[i];
+    int key = heap->keys[node];
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= heap->size) break;
+        if (child + 1 < heap->size && heap->keys[heap->nodes[child + 1]] < heap->keys[heap->nodes[child]]) {
+            child++;
+        }
+        int childNode = heap->nodes[child];
+        if (heap->keys[childNode] >= key) break;
+        heap->nodes[i] = childNode;
+        heap->position[childNode] = i;
+        i = child;
     }
-    initGraph(graph, nodes);
+    heap->nodes[i] = node;
+    heap->position[node] = i;
+}
 
-    printf(BLUE "Enter the number of edges: " RESET);
-    scanf("%d", &edges);
-    printf(YELLOW "Enter the details for each edge:\n" RESET);
-    printf(YELLOW "Format: 'source_node' 'destination_node' 'weight'\n" RESET);
-    printf(YELLOW "Example: 0 1 5 (indicates an edge from node 0 to node 1 with a weight of 5)\n" RESET);
+// Insert node with the given key, or lower its key if it is already queued
+void heapPushOrDecrease(IndexedMinHeap* heap, int node, int key) {
+    if (heap->position[node] == -1) {
+        COUNT(heapPushes);
+        heap->keys[node] = key;
+        heap->nodes[heap->size] = node;
+        heap->position[node] = heap->size;
+        heap->size++;
+        heapSiftUp(heap, heap->size - 1);
+    } else if (key < heap->keys[node]) {
+        COUNT(heapDecreases);
+        heap->keys[node] = key;
+        heapSiftUp(heap, heap->position[node]);
+    }
+}
 
-    for (int i = 0; i < edges; i++) {
-        printf(BLUE "Please enter edge %d: " RESET, i + 1);
-        if (scanf("%d %d %d", &u, &v, &weight) != 3) {
-            printf(RED "Invalid input. Please enter three integers.\n" RESET);
-            i--; // Repeat this iteration
-            while (getchar() != '\n'); // Clear the invalid input
-            continue; // Skip to the next iteration
+// Remove and return the node with the smallest key
+int heapPopMin(IndexedMinHeap* heap) {
+    COUNT(heapPops);
+    int top = heap->nodes[0];
+    heap->position[top] = -1;
+    heap->size--;
+    if (heap->size > 0) {
+        heap->nodes[0] = heap->nodes[heap->size];
+        heapSiftDown(heap, 0);
+    }
+    return top;
+}
+
+void freeIndexedMinHeap(IndexedMinHeap* heap) {
+    free(heap->nodes);
+    free(heap->position);
+    free(heap->keys);
+    free(heap);
+}
+
+// O((V + E) log V) Dijkstra over a CSR snapshot. The heap must be empty and
+// sized for csr->nodeCount; it is left empty again on return.
+void dijkstraHeapDistances(const CSRGraph* csr, int source, int* distances, int* prev, IndexedMinHeap* heap) {
+    for (int i = 0; i < csr->nodeCount; i++) {
+        distances[i] = INT_MAX;
+        prev[i] = -1;
+    }
+    distances[source] = 0;
+    heapPushOrDecrease(heap, source, 0);
+
+    while (heap->size > 0) {
+        int u = heapPopMin(heap);
+        int du = distances[u];
+        COUNT(scans);
+        COUNT_ADD(relaxations, csr->offsets[u + 1] - csr->offsets[u]);
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++) {
+            int v = csr->targets[k];
+            int candidate = du + csr->weights[k];
+            if (candidate < distances[v]) {
+                COUNT(improvements);
+                distances[v] = candidate;
+                prev[v] = u;
+                heapPushOrDecrease(heap, v, candidate);
+            }
         }
-        if (isValidNode(u, nodes) && isValidNode(v, nodes)) {
-            addEdge(graph, u, v, weight);
-        } else {
-            printf(RED "Invalid edge input. Ensure nodes are valid.\n" RESET);
-            i--; // Repeat this iteration
+    }
+}
+
+void dijkstraHeap(Graph* graph, int source, ShortestPathCache* cache) {
+    ShortestPathTree* tree = cacheLookup(cache, graph, SPT_DIJKSTRA_HEAP, source);
+    if (tree == NULL) {
+        COUNTERS_BEGIN("dijkstra_heap", source, graph->nodeCount, graph->edgeCount);
+        CSRGraph csr;
+        buildCSR(graph, &csr);
+        COUNTERS_PHASE(setupSeconds);
+
+        // Check for negative weights in the graph
+        for (int k = 0; k < csr.edgeCount; k++) {
+            if (csr.weights[k] < 0) {
+                COUNTERS_PHASE(scanSeconds);
+                COUNTERS_END("negative_weight");
+                printf(RED "Negative weight found. Dijkstra's algorithm can't work with negative weights.\n" RESET);
+                freeCSR(&csr);
+                return;
+            }
         }
+        COUNTERS_PHASE(scanSeconds);
+
+        tree = createShortestPathTree(source, csr.nodeCount);
+        IndexedMinHeap* heap = createIndexedMinHeap(csr.nodeCount);
+        dijkstraHeapDistances(&csr, source, tree->distances, tree->prev, heap);
+        COUNTERS_PHASE(mainSeconds);
+        COUNTERS_END("ok");
+        freeIndexedMinHeap(heap);
+        freeCSR(&csr);
+        tree = cacheInsert(cache, graph, SPT_DIJKSTRA_HEAP, tree);
     }
+    printShortestPaths(GREEN, "Dijkstra's (binary heap)", source, tree->distances, tree->prev, tree->nodeCount);
+}
 
-    // Display the graph
-    printf(MAGENTA "Graph connections:\n" RESET);
-    for (int i = 0; i < nodes; i++) {
-        Edge* edge = graph->adjacencyList[i];
-        while (edge) {
-            printf("%d -> %d (%d)\n", i, edge->destination, edge->weight);
-            edge = edge->next;
+// Largest edge weight, or 0 for a graph without edges
+int maxEdgeWeight(const CSRGraph* csr) {
+    int maxWeight = 0;
+    for (int k = 0; k < csr->edgeCount; k++) {
+        if (csr->weights[k] > maxWeight) maxWeight = csr->weights[k];
+    }
+    return maxWeight;
+}
+
+// Create an empty queue for node ids 0..nodeCount-1 and edge weights up to maxWeight
+MonotoneQueue* createMonotoneQueue(int nodeCount, int maxWeight, MonotoneQueueKind kind) {
+    MonotoneQueue* queue = (MonotoneQueue*)calloc(1, sizeof(MonotoneQueue));
+    if (kind == QUEUE_AUTO) kind = maxWeight <= DIAL_MAX_WEIGHT ? QUEUE_DIAL : QUEUE_RADIX;
+    queue->kind = kind;
+    queue->keys = (unsigned*)malloc((nodeCount > 0 ? nodeCount : 1) * sizeof(unsigned));
+    for (int v = 0; v < nodeCount; v++) {
+        queue->keys[v] = UINT_MAX;
+    }
+
+    if (kind == QUEUE_DIAL) {
+        queue->bucketCount = maxWeight + 1;
+        queue->bucketHead = (int*)malloc(queue->bucketCount * sizeof(int));
+        queue->next = (int*)malloc((nodeCount > 0 ? nodeCount : 1) * sizeof(int));
+        queue->previous = (int*)malloc((nodeCount > 0 ? nodeCount : 1) * sizeof(int));
+        for (int b = 0; b < queue->bucketCount; b++) {
+            queue->bucketHead[b] = -1;
         }
     }
-    printDivider();
+    return queue;
+}
 
-    // Choose a source node
-    int source;
-    printf(BLUE "Enter source node (0-%d): " RESET, nodes - 1);
-    scanf("%d", &source);
-    if (!isValidNode(source, nodes)) {
-        printf(RED "Invalid source node.\n" RESET);
+static void dialUnlink(MonotoneQueue* queue, int node) {
+    int next = queue->next[node], previous = queue->previous[node];
+    if (previous != -1) {
+        queue->next[previous] = next;
+    } else {
+        queue->bucketHead[queue->keys[node] % queue->bucketCount] = next;
+    }
+    if (next != -1) queue->previous[next] = previous;
+}
+
+static int radixBucket(const MonotoneQueue* queue, unsigned key) {
+    return key == queue->last ? 0 : 32 - __builtin_clz(key ^ queue->last);
+}
+
+static void radixAppend(MonotoneQueue* queue, int bucket, uint64_t entry) {
+    if (queue->entryCount[bucket] == queue->entryCapacity[bucket]) {
+        queue->entryCapacity[bucket] = queue->entryCapacity[bucket] > 0 ? queue->entryCapacity[bucket] * 2 : 64;
+        queue->entries[bucket] = (uint64_t*)realloc(queue->entries[bucket],
+                                                    (size_t)queue->entryCapacity[bucket] * sizeof(uint64_t));
+    }
+    queue->entries[bucket][queue->entryCount[bucket]++] = entry;
+}
+
+// Insert node with the given key, or lower its key if it is already queued.
+// The key must not be below the last key popped.
+void monotonePushOrDecrease(MonotoneQueue* queue, int node, int key) {
+    if (queue->keys[node] == UINT_MAX) {
+        COUNT(heapPushes);
+        queue->size++;
+    } else if ((unsigned)key < queue->keys[node]) {
+        COUNT(heapDecreases);
+        if (queue->kind == QUEUE_DIAL) dialUnlink(queue, node);
+    } else {
         return;
     }
+    queue->keys[node] = (unsigned)key;
 
-    // Algorithm selection loop with changing source option
-    while (1) {
-        printf(BLUE "Choose the algorithm to use:\n" RESET);
-        printf("1. Dijkstra's Algorithm\n");
-        printf("2. Bellman-Ford Algorithm\n");
-        printf("3. Change Source Node\n");
-        printf("4. Go back to main menu\n");
-        printf(BLUE "Enter your choice (1, 2, 3, or 4): " RESET);
-        int choice;
-        scanf("%d", &choice);
+    if (queue->kind == QUEUE_DIAL) {
+        int bucket = (unsigned)key % queue->bucketCount;
+        queue->previous[node] = -1;
+        queue->next[node] = queue->bucketHead[bucket];
+        if (queue->bucketHead[bucket] != -1) queue->previous[queue->bucketHead[bucket]] = node;
+        queue->bucketHead[bucket] = node;
+    } else {
+        radixAppend(queue, radixBucket(queue, (unsigned)key), (uint64_t)key << 32 | (uint32_t)node);
+    }
+}
 
-        if (choice == 1) {
-            dijkstra(graph, source);
-        } else if (choice == 2) {
-            bellmanFord(graph, source);
-        } else if (choice == 3) {
-            printf(BLUE "Enter new source node (0-%d): " RESET, nodes - 1);
-            scanf("%d", &source);
-            if (!isValidNode(source, nodes)) {
-                printf(RED "Invalid source node.\n" RESET);
+// Remove and return the node with the smallest key. The queue must not be empty.
+int monotonePopMin(MonotoneQueue* queue) {
+    COUNT(heapPops);
+    queue->size--;
+
+    if (queue->kind == QUEUE_DIAL) {
+        // All queued keys lie within bucketCount of the cursor, so the first
+        // non-empty bucket holds the minimum
+        while (queue->bucketHead[queue->cursor] == -1) {
+            queue->cursor = queue->cursor + 1 == queue->bucketCount ? 0 : queue->cursor + 1;
+        }
+        int node = queue->bucketHead[queue->cursor];
+        dialUnlink(queue, node);
+        queue->keys[node] = UINT_MAX;
+        return node;
+    }
+
+    while (1) {
+        // Bucket 0 holds keys equal to the last one popped; skip stale entries
+        while (queue->entryCount[0] > 0) {
+            uint64_t entry = queue->entries[0][--queue->entryCount[0]];
+            int node = (int)(uint32_t)entry;
+            if (queue->keys[node] == (unsigned)(entry >> 32)) {
+                queue->keys[node] = UINT_MAX;
+                return node;
             }
-        } else if (choice == 4) {
-            return; // Go back to main menu
-        } else {
-            printf(RED "Invalid choice of algorithm.\n" RESET);
         }
+
+        // Advance last to the smallest live key in the first non-empty bucket
+        // and spread that bucket over the lower ones
+        int bucket = 1;
+        while (queue->entryCount[bucket] == 0) bucket++;
+        uint64_t* entries = queue->entries[bucket];
+        int count = queue->entryCount[bucket];
+        unsigned minimum = UINT_MAX;
+        for (int i = 0; i < count; i++) {
+            unsigned key = (unsigned)(entries[i] >> 32);
+            if (queue->keys[(uint32_t)entries[i]] == key && key < minimum) minimum = key;
+        }
+        queue->entryCount[bucket] = 0;
+        if (minimum == UINT_MAX) continue;
+
+        queue->last = minimum;
+        for (int i = 0; i < count; i++) {
+            unsigned key = (unsigned)(entries[i] >> 32);
+            if (queue->keys[(uint32_t)entries[i]] == key) radixAppend(queue, radixBucket(queue, key), entries[i]);
+        }
+    }
+}
+
+void freeMonotoneQueue(MonotoneQueue* queue) {
+    free(queue->keys);
+    free(queue->bucketHead);
+    free(queue->next);
+    free(queue->previous);
+    for (int b = 0; b < RADIX_BUCKETS; b++) {
+        free(queue->entries[b]);
     }
-}
\ No newline at end of file
+    free(queue);
+}
+
+// Dijkstra over a CSR snapshot with non-negative weights no larger than the
+// queue was created for. Each pop and push is O(1) amortised (O(log C) for
+// the radix heap), against O(log V) for the binary heap. The queue must hold
+// no nodes. The radix heap may still hold stale entries from decrease-keys
+// of an earlier run; they are dropped here, since their buckets were chosen
+// against that run's last key.
+void dijkstraMonotoneDistances(const CSRGraph* csr, int source, int* distances, int* prev, MonotoneQueue* queue) {
+    for (int i = 0; i < csr->nodeCount; i++) {
+        distances[i] = INT_MAX;
+        prev[i] = -1;
+    }
+    distances[source] = 0;
+    queue->cursor = 0;
+    queue->last = 0;
+    for (int b = 0; b < RADIX_BUCKETS; b++) {
+        queue->entryCount[b] = 0;
+    }
+    monotonePushOrDecrease(queue, source, 0);
+
+    while (queue->size > 0) {
+        int u = monotonePopMin(queue);
+        int du = distances[u];
+        COUNT(scans);
+        COUNT_ADD(relaxations, csr->offsets[u + 1] - csr->offsets[u]);
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++) {
+            int v = csr->targets[k];
+            int candidate = du + csr->weights[k];
+            if (candidate < distances[v]) {
+                COUNT(improvements);
+                distances[v] = candidate;
+                prev[v] = u;
+                monotonePushOrDecrease(queue, v, candidate);
+            }
+        }
+    }
+}
+
+// Look for a cycle in the predecessor graph. Returns its length and stores the
+// cycle in edge order (cycle[0] -> cycle[1] -> ... -> cycle[0]), or 0 if none.
+int findPredecessorCycle(const int* prev, int nodeCount, int* cycle) {
+    int* stamp = (int*)malloc(nodeCount * sizeof(int));
+    for (int i = 0; i < nodeCount; i++) {
+        stamp[i] = -1;
+    }
+
+    int length = 0;
+    for (int start = 0; start < nodeCount && length == 0; start++) {
+        // Walk the chain from start, stamping nodes; meeting our own stamp means a cycle
+        int v = start;
+        while (v != -1 && stamp[v] == -1) {
+            stamp[v] = start;
+            v = prev[v];
+        }
+        if (v == -1 || stamp[v] != start) continue;
+
+        int u = v;
+        do {
+            cycle[length++] = u;
+            u = prev[u];
+        } while (u != v);
+    }
+    free(stamp);
+
+    // The chain was collected walking predecessors, so reverse it into edge order
+    for (int i = 0, j = length - 1; i < j; i++, j--) {
+        int temp = cycle[i];
+        cycle[i] = cycle[j];
+        cycle[j] = temp;
+    }
+    return length;
+}
+
+// Queue-based Bellman-Ford (SPFA): only vertices whose distance changed are
+// rescanned, and the run ends as soon as the queue drains. A shortest path can
+// use at most V-1 edges, so a vertex relaxed along a path of V or more edges
+// proves a negative cycle; its length is returned and the cycle is stored in
+// cycle (sized for nodeCount). Returns 0 when the distances are final.
+int spfaDistances(const CSRGraph* csr, int source, int* distances, int* prev, int* cycle) {
+    int n = csr->nodeCount;
+    int* queue = (int*)malloc(n * sizeof(int));
+    int* pathEdges = (int*)calloc(n, sizeof(int));
+    char* inQueue = (char*)calloc(n, sizeof(char));
+    int head = 0, count = 0;
+    int cycleLength = 0;
+
+    for (int i = 0; i < n; i++) {
+        distances[i] = INT_MAX;
+        prev[i] = -1;
+    }
+    distances[source] = 0;
+    queue[0] = source;
+    inQueue[source] = 1;
+    count = 1;
+
+    while (count > 0 && cycleLength == 0) {
+        int u = queue[head];
+        head = (head + 1) % n;
+        count--;
+        inQueue[u] = 0;
+        COUNT(scans);
+
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++) {
+            int v = csr->targets[k];
+            int candidate = distances[u] + csr->weights[k];
+            COUNT(relaxations);
+            if (candidate >= distances[v]) continue;
+
+            COUNT(improvements);
+            distances[v] = candidate;
+            prev[v] = u;
+            pathEdges[v] = pathEdges[u] + 1;
+            if (pathEdges[v] >= n) {
+                cycleLength = findPredecessorCycle(prev, n, cycle);
+                if (cycleLength > 0) break;
+            }
+            if (!inQueue[v]) {
+                queue[(head + count) % n] = v;
+                count++;
+                inQueue[v] = 1;
+            }
+        }
+    }
+
+    free(queue);
+    free(pathEdges);
+    free(inQueue);
+    return cycleLength;
+}
+
+// Queue-based Bellman-Ford tree for source, from the cache when possible.
+// Prints the cycle and returns NULL if a negative cycle is reachable.
+static ShortestPathTree* queueBellmanFordTree(Graph* graph, int source, ShortestPathCache* cache) {
+    ShortestPathTree* tree = cacheLookup(cache, graph, SPT_QUEUE_BELLMAN_FORD, source);
+    if (tree != NULL) return tree;
+
+    COUNTERS_BEGIN("spfa", source, graph->nodeCount, graph->edgeCount);
+    CSRGraph csr;
+    buildCSR(graph, &csr);
+    tree = createShortestPathTree(source, csr.nodeCount);
+    int* cycle = (int*)malloc(csr.nodeCount * sizeof(int));
+    COUNTERS_PHASE(setupSeconds);
+
+    int cycleLength = spfaDistances(&csr, source, tree->distances, tree->prev, cycle);
+    COUNTERS_PHASE(mainSeconds);
+    COUNTERS_END(cycleLength > 0 ? "negative_cycle" : "ok");
+    if (cycleLength > 0) {
+        printf(RED "Graph contains a negative weight cycle: " RESET);
+        for (int i = 0; i < cycleLength; i++) {
+            printf("%d -> ", cycle[i]);
+        }
+        printf("%d\n", cycle[0]);
+        freeShortestPathTree(tree);
+        tree = NULL;
+    } else {
+        tree = cacheInsert(cache, graph, SPT_QUEUE_BELLMAN_FORD, tree);
+    }
+
+    free(cycle);
+    freeCSR(&csr);
+    return tree;
+}
+
+void bellmanFordQueue(Graph* graph, int source, ShortestPathCache* cache) {
+    ShortestPathTree* tree = queueBellmanFordTree(graph, source, cache);
+    if (tree != NULL) {
+        printShortestPaths(CYAN, "Bellman-Ford (queue-based)", source, tree->distances, tree->prev, tree->nodeCount);
+    }
+}
+
+void intVectorPush(IntVector* vector, int value) {
+    if (vector->size == vector->capacity) {
+        vector->capacity = vector->capacity > 0 ? vector->capacity * 2 : 64;
+        vector->data = (int*)realloc(vector->data, (size_t)vector->capacity * sizeof(int));
+    }
+    vector->data[vector->size++] = value;
+}
+
+// Number of online cores, capped at MAX_WORKER_THREADS
+int availableCores() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) return 1;
+    return cores > MAX_WORKER_THREADS ? MAX_WORKER_THREADS : (int)cores;
+}
+
+typedef struct PoolWorkerStart {
+    ThreadPool* pool;
+    int worker;
+} PoolWorkerStart;
+
+static void* poolWorkerMain(void* arg) {
+    PoolWorkerStart start = *(PoolWorkerStart*)arg;
+    free(arg);
+    ThreadPool* pool = start.pool;
+    int seenGeneration = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (!pool->shuttingDown && pool->generation == seenGeneration) {
+            pthread_cond_wait(&pool->startRound, &pool->lock);
+        }
+        if (pool->shuttingDown) break;
+        seenGeneration = pool->generation;
+        PoolTask task = pool->task;
+        void* taskArg = pool->arg;
+        pthread_mutex_unlock(&pool->lock);
+
+        task(taskArg, start.worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            pthread_cond_signal(&pool->roundDone);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+ThreadPool* createThreadPool(int workerCount) {
+    ThreadPool* pool = (ThreadPool*)calloc(1, sizeof(ThreadPool));
+    pool->workerCount = workerCount < 1 ? 1 : workerCount;
+    pool->threads = (pthread_t*)malloc(pool->workerCount * sizeof(pthread_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->startRound, NULL);
+    pthread_cond_init(&pool->roundDone, NULL);
+
+    for (int i = 1; i < pool->workerCount; i++) {
+        PoolWorkerStart* start = (PoolWorkerStart*)malloc(sizeof(PoolWorkerStart));
+        start->pool = pool;
+        start->worker = i;
+        if (pthread_create(&pool->threads[i], NULL, poolWorkerMain, start) != 0) {
+            // Run with the workers we managed to start
+            free(start);
+            pool->workerCount = i;
+            break;
+        }
+    }
+    return pool;
+}
+
+// Run task on every worker (the caller is worker 0) and wait for all of them
+void threadPoolRun(ThreadPool* pool, PoolTask task, void* arg) {
+    if (pool->workerCount > 1) {
+        pthread_mutex_lock(&pool->lock);
+        pool->task = task;
+        pool->arg = arg;
+        pool->pending = pool->workerCount - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->startRound);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    task(arg, 0);
+
+    if (pool->workerCount > 1) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->pending > 0) {
+            pthread_cond_wait(&pool->roundDone, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+void freeThreadPool(ThreadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shuttingDown = 1;
+    pthread_cond_broadcast(&pool->startRound);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->workerCount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->startRound);
+    pthread_cond_destroy(&pool->roundDone);
+    free(pool->threads);
+    free(pool);
+}
+
+// Shared state for one delta-stepping relaxation round
+typedef struct DeltaRound {
+    const int* offsets;
+    const int* lightEnd; // Edges of u in [offsets[u], lightEnd[u]) weigh at most delta
+    const int* targets;
+    const int* weights;
+    uint64_t* state;     // (distance << 32) | predecessor, updated with CAS
+    const int* frontier;
+    int frontierSize;
+    int cursor;          // Next unclaimed frontier index
+    int heavy;           // Relax the heavy edges instead of the light ones
+    IntVector* improved; // Per-worker lists of vertices whose distance dropped
+} DeltaRound;
+
+static uint64_t packDistance(int distance, int predecessor) {
+    return ((uint64_t)(uint32_t)distance << 32) | (uint32_t)predecessor;
+}
+
+static int stateDistance(uint64_t state) {
+    return (int)(state >> 32);
+}
+
+// Lower v's distance to candidate if that is an improvement; safe to race
+static int relaxAtomic(uint64_t* state, int v, int candidate, int predecessor) {
+    uint64_t desired = packDistance(candidate, predecessor);
+    uint64_t current = __atomic_load_n(&state[v], __ATOMIC_RELAXED);
+    while (stateDistance(current) > candidate) {
+        if (__atomic_compare_exchange_n(&state[v], &current, desired, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void deltaRelaxTask(void* arg, int worker) {
+    DeltaRound* round = (DeltaRound*)arg;
+    IntVector* improved = &round->improved[worker];
+
+    while (1) {
+        int begin = __atomic_fetch_add(&round->cursor, DELTA_CHUNK, __ATOMIC_RELAXED);
+        if (begin >= round->frontierSize) break;
+        int end = begin + DELTA_CHUNK < round->frontierSize ? begin + DELTA_CHUNK : round->frontierSize;
+
+        for (int i = begin; i < end; i++) {
+            int u = round->frontier[i];
+            int du = stateDistance(__atomic_load_n(&round->state[u], __ATOMIC_RELAXED));
+            int from = round->heavy ? round->lightEnd[u] : round->offsets[u];
+            int to = round->heavy ? round->offsets[u + 1] : round->lightEnd[u];
+            for (int k = from; k < to; k++) {
+                int v = round->targets[k];
+                if (relaxAtomic(round->state, v, du + round->weights[k], u)) {
+                    intVectorPush(improved, v);
+                }
+            }
+        }
+    }
+}
+
+// Relax one edge class of the frontier, in parallel if the frontier is large
+// enough, then file every improved vertex into the bucket of its new distance
+static void deltaRunRound(DeltaRound* round, ThreadPool* pool, IntVector* buckets, int ringSize,
+                          int delta, int* liveEntries) {
+    round->cursor = 0;
+    if (round->frontierSize >= DELTA_PARALLEL_THRESHOLD && pool->workerCount > 1) {
+        threadPoolRun(pool, deltaRelaxTask, round);
+    } else {
+        deltaRelaxTask(round, 0);
+    }
+
+    for (int w = 0; w < pool->workerCount; w++) {
+        IntVector* improved = &round->improved[w];
+        for (int i = 0; i < improved->size; i++) {
+            int v = improved->data[i];
+            int bucket = stateDistance(round->state[v]) / delta;
+            intVectorPush(&buckets[bucket % ringSize], v);
+            (*liveEntries)++;
+        }
+        improved->size = 0;
+    }
+}
+
+// Parallel delta-stepping SSSP for non-negative weights. Vertices are kept in
+// buckets of width delta; each bucket is drained by repeatedly relaxing its
+// light edges (weight <= delta) in parallel, after which the heavy edges of
+// every vertex settled in the bucket are relaxed once. Since no live distance
+// is ever more than maxWeight + delta past the current bucket, the buckets
+// are reused as a ring of maxWeight / delta + 2 slots.
+void deltaSteppingDistances(const CSRGraph* csr, int source, int delta, int* distances, int* prev, ThreadPool* pool) {
+    int n = csr->nodeCount;
+    int maxWeight = 0;
+    for (int k = 0; k < csr->edgeCount; k++) {
+        if (csr->weights[k] > maxWeight) maxWeight = csr->weights[k];
+    }
+    if (delta < 1) delta = 1;
+
+    // Partition every adjacency range so light edges come first
+    int* lightEnd = (int*)malloc(n * sizeof(int));
+    int* targets = (int*)malloc((csr->edgeCount > 0 ? csr->edgeCount : 1) * sizeof(int));
+    int* weights = (int*)malloc((csr->edgeCount > 0 ? csr->edgeCount : 1) * sizeof(int));
+    for (int u = 0; u < n; u++) {
+        int front = csr->offsets[u];
+        int back = csr->offsets[u + 1];
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++) {
+            int slot = csr->weights[k] <= delta ? front++ : --back;
+            targets[slot] = csr->targets[k];
+            weights[slot] = csr->weights[k];
+        }
+        lightEnd[u] = front;
+    }
+
+    uint64_t* state = (uint64_t*)malloc(n * sizeof(uint64_t));
+    for (int i = 0; i < n; i++) {
+        state[i] = packDistance(INT_MAX, -1);
+    }
+    state[source] = packDistance(0, -1);
+
+    int ringSize = maxWeight / delta + 2;
+    IntVector* buckets = (IntVector*)calloc(ringSize, sizeof(IntVector));
+    IntVector frontier = {0};
+    IntVector settled = {0};
+    int* frontierStamp = (int*)malloc(n * sizeof(int));
+    int* settledStamp = (int*)malloc(n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        frontierStamp[i] = settledStamp[i] = -1;
+    }
+
+    DeltaRound round;
+    round.offsets = csr->offsets;
+    round.lightEnd = lightEnd;
+    round.targets = targets;
+    round.weights = weights;
+    round.state = state;
+    round.improved = (IntVector*)calloc(pool->workerCount, sizeof(IntVector));
+
+    intVectorPush(&buckets[0], source);
+    int liveEntries = 1;
+    int bucket = 0;
+    int roundNumber = 0;
+
+    while (liveEntries > 0) {
+        while (buckets[bucket % ringSize].size == 0) {
+            bucket++;
+        }
+
+        // Drain the bucket: light edges may refill it, so loop until it stays empty
+        settled.size = 0;
+        while (buckets[bucket % ringSize].size > 0) {
+            IntVector* slot = &buckets[bucket % ringSize];
+            IntVector taken = *slot;
+            *slot = frontier;
+            liveEntries -= taken.size;
+            frontier = taken;
+            slot->size = 0;
+
+            // Keep each vertex once, and only if its distance still maps here
+            roundNumber++;
+            int kept = 0;
+            for (int i = 0; i < frontier.size; i++) {
+                int v = frontier.data[i];
+                if (frontierStamp[v] == roundNumber || stateDistance(state[v]) / delta != bucket) continue;
+                frontierStamp[v] = roundNumber;
+                frontier.data[kept++] = v;
+                if (settledStamp[v] != bucket) {
+                    settledStamp[v] = bucket;
+                    intVectorPush(&settled, v);
+                }
+            }
+            frontier.size = kept;
+
+            round.frontier = frontier.data;
+            round.frontierSize = frontier.size;
+            round.heavy = 0;
+            deltaRunRound(&round, pool, buckets, ringSize, delta, &liveEntries);
+        }
+
+        round.frontier = settled.data;
+        round.frontierSize = settled.size;
+        round.heavy = 1;
+        deltaRunRound(&round, pool, buckets, ringSize, delta, &liveEntries);
+        bucket++;
+    }
+
+    for (int i = 0; i < n; i++) {
+        distances[i] = stateDistance(state[i]);
+        prev[i] = (int)(uint32_t)state[i];
+    }
+
+    for (int i = 0; i < ringSize; i++) {
+        free(buckets[i].data);
+    }
+    for (int w = 0; w < pool->workerCount; w++) {
+        free(round.improved[w].data);
+    }
+    free(round.improved);
+    free(buckets);
+    free(frontier.data);
+    free(settled.data);
+    free(frontierStamp);
+    free(settledStamp);
+    free(state);
+    free(lightEnd);
+    free(targets);
+    free(weights);
+}
+
+// Common heuristic: bucket width of max weight over average out-degree
+int defaultDeltaWidth(const CSRGraph* csr) {
+    int maxWeight = 0;
+    for (int k = 0; k < csr->edgeCount; k++) {
+        if (csr->weights[k] > maxWeight) maxWeight = csr->weights[k];
+    }
+    int averageDegree = csr->nodeCount > 0 ? csr->edgeCount / csr->nodeCount : 0;
+    return maxWeight / (averageDegree > 0 ? averageDegree : 1);
+}
+
+void deltaStepping(Graph* graph, int source) {
+    CSRGraph csr;
+    buildCSR(graph, &csr);
+
+    for (int k = 0; k < csr.edgeCount; k++) {
+        if (csr.weights[k] < 0) {
+            printf(RED "Negative weight found. Delta-stepping can't work with negative weights.\n" RESET);
+            freeCSR(&csr);
+            return;
+        }
+    }
+    int delta = defaultDeltaWidth(&csr);
+
+    int* distances = (int*)malloc(csr.nodeCount * sizeof(int));
+    int* prev = (int*)malloc(csr.nodeCount * sizeof(int));
+    ThreadPool* pool = createThreadPool(availableCores());
+
+    deltaSteppingDistances(&csr, source, delta, distances, prev, pool);
+    printShortestPaths(GREEN, "Delta-stepping", source, distances, prev, csr.nodeCount);
+    printf("Used %d worker thread(s), bucket width %d.\n", pool->workerCount, delta < 1 ? 1 : delta);
+
+    // Cross-check against the sequential algorithm
+    int* expected = (int*)malloc(csr.nodeCount * sizeof(int));
+    int* expectedPrev = (int*)malloc(csr.nodeCount * sizeof(int));
+    dijkstraDistances(graph, source, expected, expectedPrev);
+    int mismatches = 0;
+    for (int i = 0; i < csr.nodeCount; i++) {
+        if (distances[i] != expected[i]) mismatches++;
+    }
+    if (mismatches == 0) {
+        printf(GREEN "Verified: distances match Dijkstra's algorithm.\n" RESET);
+    } else {
+        printf(RED "%d distance(s) differ from Dijkstra's algorithm.\n" RESET, mismatches);
+    }
+
+    freeThreadPool(pool);
+    free(expected);
+    free(expectedPrev);
+    free(distances);
+    free(prev);
+    freeCSR(&csr);
+}
+
+// Shared state for the per-source Dijkstra fan-out in Johnson's algorithm
+typedef struct JohnsonJob {
+    CSRGraph reweighted;
+    const int* potential;
+    StealQueue* queues;
+    int workerCount;
+    int fd;
+    long headerSize;
+    int writeFailed;
+} JohnsonJob;
+
+// Claim the next source from our own queue, else steal from another worker
+static int claimSource(JohnsonJob* job, int worker) {
+    for (int i = 0; i < job->workerCount; i++) {
+        StealQueue* queue = &job->queues[(worker + i) % job->workerCount];
+        if (__atomic_load_n(&queue->next, __ATOMIC_RELAXED) >= queue->end) continue;
+        int source = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+        if (source < queue->end) return source;
+    }
+    return -1;
+}
+
+static void johnsonTask(void* arg, int worker) {
+    JohnsonJob* job = (JohnsonJob*)arg;
+    int n = job->reweighted.nodeCount;
+    int* distances = (int*)malloc(n * sizeof(int));
+    int* prev = (int*)malloc(n * sizeof(int));
+    IndexedMinHeap* heap = createIndexedMinHeap(n);
+
+    int source;
+    while ((source = claimSource(job, worker)) != -1) {
+        dijkstraHeapDistances(&job->reweighted, source, distances, prev, heap);
+
+        // Undo the reweighting: d(u, v) = d'(u, v) - h(u) + h(v)
+        for (int v = 0; v < n; v++) {
+            if (distances[v] != INT_MAX) {
+                distances[v] = distances[v] - job->potential[source] + job->potential[v];
+            }
+        }
+
+        size_t rowBytes = (size_t)n * sizeof(int);
+        off_t offset = (off_t)job->headerSize + (off_t)source * (off_t)rowBytes;
+        if (pwrite(job->fd, distances, rowBytes, offset) != (ssize_t)rowBytes) {
+            __atomic_store_n(&job->writeFailed, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    freeIndexedMinHeap(heap);
+    free(distances);
+    free(prev);
+}
+
+// Johnson's all-pairs shortest paths. Bellman-Ford from a virtual source
+// joined to every node yields potentials h that make every edge weight
+// w + h(u) - h(v) non-negative; one Dijkstra per source then runs on the
+// reweighted graph across the pool. The V x V matrix is written row-major to
+// outputPath as: "APSP", uint32 version, uint32 node count, then int32
+// distances with INT_MAX for unreachable pairs.
+// Returns 1 on success, 0 for a negative cycle and -1 on an I/O error.
+int johnsonAllPairs(Graph* graph, const char* outputPath, ThreadPool* pool) {
+    int n = graph->nodeCount;
+
+    // Graph plus virtual source n with a zero-weight edge to every node
+    Graph augmented = {0};
+    initGraph(&augmented, n + 1);
+    for (int u = 0; u < n; u++) {
+        for (Edge* edge = graph->adjacencyList[u]; edge != NULL; edge = edge->next) {
+            addEdge(&augmented, u, edge->destination, edge->weight);
+        }
+        addEdge(&augmented, n, u, 0);
+    }
+
+    int* potential = (int*)malloc((n + 1) * sizeof(int));
+    int* potentialPrev = (int*)malloc((n + 1) * sizeof(int));
+    int hasNoNegativeCycle = bellmanFordDistances(&augmented, n, potential, potentialPrev);
+    freeGraph(&augmented);
+    free(potentialPrev);
+    if (!hasNoNegativeCycle) {
+        free(potential);
+        return 0;
+    }
+
+    FILE* outputFile = fopen(outputPath, "wb");
+    if (!outputFile) {
+        free(potential);
+        return -1;
+    }
+    uint32_t version = APSP_VERSION;
+    uint32_t nodeCount = (uint32_t)n;
+    if (fwrite(APSP_MAGIC, 1, 4, outputFile) != 4 || fwrite(&version, sizeof(uint32_t), 1, outputFile) != 1 ||
+        fwrite(&nodeCount, sizeof(uint32_t), 1, outputFile) != 1 || fflush(outputFile) != 0) {
+        fclose(outputFile);
+        free(potential);
+        return -1;
+    }
+
+    JohnsonJob job;
+    buildCSR(graph, &job.reweighted);
+    for (int u = 0; u < n; u++) {
+        for (int k = job.reweighted.offsets[u]; k < job.reweighted.offsets[u + 1]; k++) {
+            job.reweighted.weights[k] += potential[u] - potential[job.reweighted.targets[k]];
+        }
+    }
+    job.potential = potential;
+    job.workerCount = pool->workerCount;
+    job.fd = fileno(outputFile);
+    job.headerSize = APSP_HEADER_SIZE;
+    job.writeFailed = 0;
+    job.queues = (StealQueue*)calloc(pool->workerCount, sizeof(StealQueue));
+    for (int w = 0; w < pool->workerCount; w++) {
+        job.queues[w].next = (int)((long long)n * w / pool->workerCount);
+        job.queues[w].end = (int)((long long)n * (w + 1) / pool->workerCount);
+    }
+
+    threadPoolRun(pool, johnsonTask, &job);
+
+    int status = job.writeFailed ? -1 : 1;
+    if (fclose(outputFile) != 0) status = -1;
+    free(job.queues);
+    freeCSR(&job.reweighted);
+    free(potential);
+    return status;
+}
+
+void allPairsShortestPaths(Graph* graph) {
+    char outputPath[256];
+    printf(BLUE "Enter the output path for the distance matrix (e.g. resources/apsp.bin): " RESET);
+    scanf("%255s", outputPath);
+
+    ThreadPool* pool = createThreadPool(availableCores());
+    int status = johnsonAllPairs(graph, outputPath, pool);
+    int workers = pool->workerCount;
+    freeThreadPool(pool);
+
+    if (status == 0) {
+        printf(RED "Graph contains a negative weight cycle.\n" RESET);
+        return;
+    }
+    if (status < 0) {
+        printf(RED "Error writing distance matrix: %s\n" RESET, outputPath);
+        return;
+    }
+
+    int n = graph->nodeCount;
+    printDivider();
+    printf(GREEN "Johnson's all-pairs distances (%d x %d) written to %s using %d worker thread(s).\n" RESET,
+           n, n, outputPath, workers);
+
+    if (n > APSP_PRINT_LIMIT) {
+        printDivider();
+        return;
+    }
+
+    // Echo small matrices back from the file
+    FILE* inputFile = fopen(outputPath, "rb");
+    if (!inputFile) {
+        printf(RED "Error reading back distance matrix: %s\n" RESET, outputPath);
+        printDivider();
+        return;
+    }
+    int* row = (int*)malloc(n * sizeof(int));
+    fseek(inputFile, APSP_HEADER_SIZE, SEEK_SET);
+    printf("From\\To");
+    for (int v = 0; v < n; v++) {
+        printf("\t%d", v);
+    }
+    printf("\n");
+    for (int u = 0; u < n; u++) {
+        if (fread(row, sizeof(int), n, inputFile) != (size_t)n) break;
+        printf("%d", u);
+        for (int v = 0; v < n; v++) {
+            if (row[v] == INT_MAX) {
+                printf("\tinf");
+            } else {
+                printf("\t%d", row[v]);
+            }
+        }
+        printf("\n");
+    }
+    free(row);
+    fclose(inputFile);
+    printDivider();
+}
+
+// Empty the heap, forgetting the positions of anything still queued
+void heapClear(IndexedMinHeap* heap) {
+    for (int i = 0; i < heap->size; i++) {
+        heap->position[heap->nodes[i]] = -1;
+    }
+    heap->size = 0;
+}
+
+// CSR of the transposed graph: the edges entering v become the edges leaving v
+void buildReverseCSR(const CSRGraph* csr, CSRGraph* reverse) {
+    int n = csr->nodeCount;
+    reverse->nodeCount = n;
+    reverse->edgeCount = csr->edgeCount;
+    reverse->offsets = (int*)calloc((size_t)n + 1, sizeof(int));
+    reverse->targets = (int*)malloc((csr->edgeCount > 0 ? csr->edgeCount : 1) * sizeof(int));
+    reverse->weights = (int*)malloc((csr->edgeCount > 0 ? csr->edgeCount : 1) * sizeof(int));
+
+    for (int k = 0; k < csr->edgeCount; k++) {
+        reverse->offsets[csr->targets[k] + 1]++;
+    }
+    for (int v = 0; v < n; v++) {
+        reverse->offsets[v + 1] += reverse->offsets[v];
+    }
+
+    int* cursor = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    memcpy(cursor, reverse->offsets, n * sizeof(int));
+    for (int u = 0; u < n; u++) {
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++) {
+            int slot = cursor[csr->targets[k]]++;
+            reverse->targets[slot] = u;
+            reverse->weights[slot] = csr->weights[k];
+        }
+    }
+    free(cursor);
+}
+
+SearchSpace* createSearchSpace(int nodeCount) {
+    SearchSpace* space = (SearchSpace*)malloc(sizeof(SearchSpace));
+    space->nodeCount = nodeCount;
+    space->distances = (int*)malloc((nodeCount > 0 ? nodeCount : 1) * sizeof(int));
+    space->prev = (int*)malloc((nodeCount > 0 ? nodeCount : 1) * sizeof(int));
+    space->stamp = (unsigned*)calloc(nodeCount > 0 ? nodeCount : 1, sizeof(unsigned));
+    space->currentStamp = 0;
+    space->heap = createIndexedMinHeap(nodeCount > 0 ? nodeCount : 1);
+    return space;
+}
+
+void freeSearchSpace(SearchSpace* space) {
+    free(space->distances);
+    free(space->prev);
+    free(space->stamp);
+    freeIndexedMinHeap(space->heap);
+    free(space);
+}
+
+static void beginSearch(SearchSpace* space) {
+    heapClear(space->heap);
+    if (++space->currentStamp == 0) {
+        // Stamp wrapped around: every node must be invalidated explicitly once
+        memset(space->stamp, 0, (size_t)space->nodeCount * sizeof(unsigned));
+        space->currentStamp = 1;
+    }
+}
+
+static int searchDistance(const SearchSpace* space, int node) {
+    return space->stamp[node] == space->currentStamp ? space->distances[node] : INT_MAX;
+}
+
+static void searchSet(SearchSpace* space, int node, int distance, int predecessor) {
+    space->stamp[node] = space->currentStamp;
+    space->distances[node] = distance;
+    space->prev[node] = predecessor;
+}
+
+// Dijkstra that stops as soon as target is settled. Returns the distance
+// (INT_MAX if unreachable); settled counts the nodes taken off the heap.
+int dijkstraToTarget(const CSRGraph* csr, int source, int target, SearchSpace* space, int* settled) {
+    return astarToTarget(csr, source, target, NULL, NULL, space, settled);
+}
+
+// A* search; a NULL heuristic degrades to target-aware Dijkstra. Nodes may be
+// reopened when a shorter path is found, so an admissible heuristic suffices.
+int astarToTarget(const CSRGraph* csr, int source, int target, Heuristic heuristic, const void* context,
+                  SearchSpace* space, int* settled) {
+    beginSearch(space);
+    *settled = 0;
+    searchSet(space, source, 0, -1);
+    heapPushOrDecrease(space->heap, source, heuristic ? heuristic(source, target, context) : 0);
+
+    while (space->heap->size > 0) {
+        int u = heapPopMin(space->heap);
+        (*settled)++;
+        COUNT(scans);
+        if (u == target) {
+            return space->distances[u];
+        }
+
+        int du = space->distances[u];
+        COUNT_ADD(relaxations, csr->offsets[u + 1] - csr->offsets[u]);
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++) {
+            int v = csr->targets[k];
+            int candidate = du + csr->weights[k];
+            if (candidate < searchDistance(space, v)) {
+                COUNT(improvements);
+                searchSet(space, v, candidate, u);
+                heapPushOrDecrease(space->heap, v, heuristic ? candidate + heuristic(v, target, context) : candidate);
+            }
+        }
+    }
+    return INT_MAX;
+}
+
+// Bidirectional Dijkstra: a forward search on csr and a backward search on
+// its transpose grow towards each other, always expanding the side with the
+// smaller tentative key. The best meeting distance mu is final once the two
+// heap minima sum to at least mu. Returns the distance (INT_MAX if unreachable)
+// and the node where the best path crosses in *meeting.
+int bidirectionalDijkstra(const CSRGraph* csr, const CSRGraph* reverse, int source, int target,
+                          SearchSpace* forward, SearchSpace* backward, int* meeting, int* settled) {
+    beginSearch(forward);
+    beginSearch(backward);
+    *settled = 0;
+    *meeting = -1;
+
+    searchSet(forward, source, 0, -1);
+    searchSet(backward, target, 0, -1);
+    heapPushOrDecrease(forward->heap, source, 0);
+    heapPushOrDecrease(backward->heap, target, 0);
+
+    long long best = INT_MAX;
+    if (source == target) {
+        *meeting = source;
+        best = 0;
+    }
+
+    while (forward->heap->size > 0 && backward->heap->size > 0) {
+        long long topForward = forward->heap->keys[forward->heap->nodes[0]];
+        long long topBackward = backward->heap->keys[backward->heap->nodes[0]];
+        if (topForward + topBackward >= best) break;
+
+        int expandForward = topForward <= topBackward;
+        SearchSpace* side = expandForward ? forward : backward;
+        SearchSpace* other = expandForward ? backward : forward;
+        const CSRGraph* edges = expandForward ? csr : reverse;
+
+        int u = heapPopMin(side->heap);
+        (*settled)++;
+        COUNT(scans);
+        int du = side->distances[u];
+        COUNT_ADD(relaxations, edges->offsets[u + 1] - edges->offsets[u]);
+        for (int k = edges->offsets[u]; k < edges->offsets[u + 1]; k++) {
+            int v = edges->targets[k];
+            int candidate = du + edges->weights[k];
+            if (candidate >= searchDistance(side, v)) continue;
+
+            COUNT(improvements);
+            searchSet(side, v, candidate, u);
+            heapPushOrDecrease(side->heap, v, candidate);
+            int otherDistance = searchDistance(other, v);
+            if (otherDistance != INT_MAX && (long long)candidate + otherDistance < best) {
+                best = (long long)candidate + otherDistance;
+                *meeting = v;
+            }
+        }
+    }
+    return *meeting == -1 ? INT_MAX : (int)best;
+}
+
+// Copy the path source .. target recorded in a search space into path.
+// Returns its node count (0 if target was not reached).
+int tracePath(const SearchSpace* space, int target, int* path) {
+    if (searchDistance(space, target) == INT_MAX) return 0;
+    int length = 0;
+    for (int v = target; v != -1; v = space->prev[v]) {
+        path[length++] = v;
+    }
+    for (int i = 0, j = length - 1; i < j; i++, j--) {
+        int temp = path[i];
+        path[i] = path[j];
+        path[j] = temp;
+    }
+    return length;
+}
+
+// Join the forward half (source .. meeting) and the backward half (meeting .. target)
+int traceBidirectionalPath(const SearchSpace* forward, const SearchSpace* backward, int meeting, int* path) {
+    if (meeting == -1) return 0;
+    int length = tracePath(forward, meeting, path);
+    for (int v = backward->prev[meeting]; v != -1; v = backward->prev[v]) {
+        path[length++] = v;
+    }
+    return length;
+}
+
+// Parse one "node x y" line. Returns 1 for a coordinate, 0 for a blank line
+// and -1 if the line is malformed.
+static int parseCoordinateLine(const char* line, long* node, double* x, double* y) {
+    const char* cursor = line + strspn(line, " \t\r\n");
+    if (*cursor == '\0' || *cursor == '#') return 0;
+
+    char* end;
+    *node = strtol(cursor, &end, 10);
+    if (end == cursor || (*end != ' ' && *end != '\t')) return -1;
+    cursor = end;
+    *x = strtod(cursor, &end);
+    if (end == cursor || (*end != ' ' && *end != '\t')) return -1;
+    cursor = end;
+    *y = strtod(cursor, &end);
+    if (end == cursor || !isfinite(*x) || !isfinite(*y)) return -1;
+    end += strspn(end, " \t\r\n");
+    return *end == '\0' || *end == '#' ? 1 : -1;
+}
+
+// Load "node x y" lines for nodes 0..nodeCount-1; '#' starts a comment and ids
+// outside the graph are skipped. Nodes without a line keep NaN coordinates.
+// Returns 0 on failure, with *errorLine set to the first malformed line or to
+// 0 if the file could not be read.
+int loadCoordinates(const char* path, int nodeCount, Coordinates* coordinates, int* errorLine) {
+    *errorLine = 0;
+    FILE* inputFile = fopen(path, "r");
+    if (!inputFile) return 0;
+
+    coordinates->nodeCount = nodeCount;
+    coordinates->x = (double*)malloc((nodeCount > 0 ? nodeCount : 1) * sizeof(double));
+    coordinates->y = (double*)malloc((nodeCount > 0 ? nodeCount : 1) * sizeof(double));
+    coordinates->scale = 1.0;
+    if (!coordinates->x || !coordinates->y) {
+        freeCoordinates(coordinates);
+        fclose(inputFile);
+        return 0;
+    }
+    for (int v = 0; v < nodeCount; v++) {
+        coordinates->x[v] = coordinates->y[v] = NAN;
+    }
+
+    char* line = NULL;
+    size_t capacity = 0;
+    int lineNumber = 0;
+    int ok = 1;
+    while (ok && getline(&line, &capacity, inputFile) != -1) {
+        long node;
+        double x, y;
+        lineNumber++;
+        int parsed = parseCoordinateLine(line, &node, &x, &y);
+        if (parsed < 0) {
+            *errorLine = lineNumber;
+            ok = 0;
+        } else if (parsed > 0 && node >= 0 && node < nodeCount) {
+            coordinates->x[node] = x;
+            coordinates->y[node] = y;
+        }
+    }
+    if (ferror(inputFile)) ok = 0;
+    free(line);
+    fclose(inputFile);
+    if (!ok) freeCoordinates(coordinates);
+    return ok;
+}
+
+void freeCoordinates(Coordinates* coordinates) {
+    free(coordinates->x);
+    free(coordinates->y);
+    coordinates->x = coordinates->y = NULL;
+}
+
+void printCoordinatesError(FILE* stream, const char* path, int errorLine) {
+    if (errorLine > 0) {
+        fprintf(stream, RED "Malformed 'node x y' line %d in coordinates file: %s\n" RESET, errorLine, path);
+    } else {
+        fprintf(stream, RED "Error reading coordinates file: %s\n" RESET, path);
+    }
+}
+
+int euclideanHeuristic(int node, int target, const void* context) {
+    const Coordinates* coordinates = (const Coordinates*)context;
+    if (isnan(coordinates->x[node]) || isnan(coordinates->x[target])) return 0;
+    double dx = coordinates->x[node] - coordinates->x[target];
+    double dy = coordinates->y[node] - coordinates->y[target];
+    return (int)floor(coordinates->scale * sqrt(dx * dx + dy * dy));
+}
+
+static void printPointToPointRow(const char* method, int distance, int settled, const int* path, int pathLength) {
+    printf("%-24s", method);
+    if (distance == INT_MAX) {
+        printf("Unreachable\t%d settled\n", settled);
+        return;
+    }
+    printf("%d\t\t%d settled\tPath: ", distance, settled);
+    for (int i = 0; i < pathLength; i++) {
+        printf(i == 0 ? "%d" : " -> %d", path[i]);
+    }
+    printf("\n");
+}
+
+// Single source/target query comparing the target-aware searches
+void pointToPointQuery(Graph* graph, int source) {
+    int target;
+    printf(BLUE "Enter target node (0-%d): " RESET, graph->nodeCount - 1);
+    scanf("%d", &target);
+    if (!isValidNode(target, graph->nodeCount)) {
+        printf(RED "Invalid target node.\n" RESET);
+        return;
+    }
+
+    CSRGraph csr, reverse;
+    buildCSR(graph, &csr);
+    for (int k = 0; k < csr.edgeCount; k++) {
+        if (csr.weights[k] < 0) {
+            printf(RED "Negative weight found. Point-to-point searches can't work with negative weights.\n" RESET);
+            freeCSR(&csr);
+            return;
+        }
+    }
+    buildReverseCSR(&csr, &reverse);
+
+    char coordinatesPath[256];
+    Coordinates coordinates;
+    int haveCoordinates = 0;
+    int errorLine;
+    printf(BLUE "Enter a coordinates file for A* ('node x y' lines), or '-' to skip: " RESET);
+    scanf("%255s", coordinatesPath);
+    if (strcmp(coordinatesPath, "-") != 0) {
+        haveCoordinates = loadCoordinates(coordinatesPath, csr.nodeCount, &coordinates, &errorLine);
+        if (!haveCoordinates) {
+            printCoordinatesError(stdout, coordinatesPath, errorLine);
+        } else {
+            printf(BLUE "Enter the minimum edge weight per unit of distance (heuristic scale): " RESET);
+            scanf("%lf", &coordinates.scale);
+        }
+    }
+
+    SearchSpace* forward = createSearchSpace(csr.nodeCount);
+    SearchSpace* backward = createSearchSpace(csr.nodeCount);
+    int* path = (int*)malloc(csr.nodeCount * sizeof(int));
+    int settled, meeting, distance;
+
+    printDivider();
+    printf(GREEN "Shortest path from node %d to node %d:\n" RESET, source, target);
+    printf("Method\t\t\tDistance\tWork\n");
+
+    distance = dijkstraToTarget(&csr, source, target, forward, &settled);
+    printPointToPointRow("Dijkstra (early stop)", distance, settled, path, tracePath(forward, target, path));
+
+    distance = bidirectionalDijkstra(&csr, &reverse, source, target, forward, backward, &meeting, &settled);
+    printPointToPointRow("Bidirectional Dijkstra", distance, settled, path,
+                         traceBidirectionalPath(forward, backward, meeting, path));
+
+    if (haveCoordinates) {
+        distance = astarToTarget(&csr, source, target, euclideanHeuristic, &coordinates, forward, &settled);
+        printPointToPointRow("A* (Euclidean)", distance, settled, path, tracePath(forward, target, path));
+        freeCoordinates(&coordinates);
+    }
+    printf("A full Dijkstra run settles every node reachable from %d.\n", source);
+    printDivider();
+
+    free(path);
+    freeSearchSpace(forward);
+    freeSearchSpace(backward);
+    freeCSR(&reverse);
+    freeCSR(&csr);
+}
+
+static void arcListPut(CHArcList* list, int node, int weight, int middle) {
+    for (int i = 0; i < list->size; i++) {
+        if (list->arcs[i].node == node) {
+            if (weight < list->arcs[i].weight) {
+                list->arcs[i].weight = weight;
+                list->arcs[i].middle = middle;
+            }
+            return;
+        }
+    }
+    if (list->size == list->capacity) {
+        list->capacity = list->capacity > 0 ? list->capacity * 2 : 4;
+        list->arcs = (CHArc*)realloc(list->arcs, (size_t)list->capacity * sizeof(CHArc));
+    }
+    list->arcs[list->size].node = node;
+    list->arcs[list->size].weight = weight;
+    list->arcs[list->size].middle = middle;
+    list->size++;
+}
+
+static void arcListRemove(CHArcList* list, int node) {
+    for (int i = 0; i < list->size; i++) {
+        if (list->arcs[i].node == node) {
+            list->arcs[i] = list->arcs[--list->size];
+            return;
+        }
+    }
+}
+
+// Working state while contracting a graph
+typedef struct Contraction {
+    int nodeCount;
+    CHArcList* out;
+    CHArcList* in;
+    char* contracted;
+    int* contractedNeighbors;
+    SearchSpace* witness;
+    CHArc* pending;    // Shortcuts found by the last contractNode call (node = from, middle = to)
+    int pendingCount;
+    int pendingCapacity;
+} Contraction;
+
+// Dijkstra from u over the remaining graph without node skip, bounded by
+// maxDistance and CH_WITNESS_SETTLE_LIMIT settled nodes
+static void witnessSearch(Contraction* state, int u, int skip, int maxDistance) {
+    SearchSpace* space = state->witness;
+    beginSearch(space);
+    searchSet(space, u, 0, -1);
+    heapPushOrDecrease(space->heap, u, 0);
+
+    int settled = 0;
+    while (space->heap->size > 0 && settled < CH_WITNESS_SETTLE_LIMIT) {
+        int x = heapPopMin(space->heap);
+        int dx = space->distances[x];
+        if (dx > maxDistance) break;
+        settled++;
+
+        CHArcList* arcs = &state->out[x];
+        for (int i = 0; i < arcs->size; i++) {
+            int y = arcs->arcs[i].node;
+            if (y == skip) continue;
+            int candidate = dx + arcs->arcs[i].weight;
+            if (candidate < searchDistance(space, y)) {
+                searchSet(space, y, candidate, x);
+                heapPushOrDecrease(space->heap, y, candidate);
+            }
+        }
+    }
+}
+
+// Collect in state->pending the shortcuts contracting v needs: u -> v -> w
+// becomes a shortcut unless a witness path no longer than it exists
+static int contractNode(Contraction* state, int v) {
+    CHArcList* in = &state->in[v];
+    CHArcList* out = &state->out[v];
+    state->pendingCount = 0;
+
+    int maxOut = 0;
+    for (int j = 0; j < out->size; j++) {
+        if (out->arcs[j].weight > maxOut) maxOut = out->arcs[j].weight;
+    }
+
+    for (int i = 0; i < in->size; i++) {
+        int u = in->arcs[i].node;
+        int toV = in->arcs[i].weight;
+        witnessSearch(state, u, v, toV + maxOut);
+
+        for (int j = 0; j < out->size; j++) {
+            int w = out->arcs[j].node;
+            if (w == u) continue;
+            int viaV = toV + out->arcs[j].weight;
+            if (searchDistance(state->witness, w) <= viaV) continue;
+
+            if (state->pendingCount == state->pendingCapacity) {
+                state->pendingCapacity = state->pendingCapacity > 0 ? state->pendingCapacity * 2 : 64;
+                state->pending = (CHArc*)realloc(state->pending, (size_t)state->pendingCapacity * sizeof(CHArc));
+            }
+            CHArc* shortcut = &state->pending[state->pendingCount++];
+            shortcut->node = u;
+            shortcut->middle = w;
+            shortcut->weight = viaV;
+        }
+    }
+    return state->pendingCount;
+}
+
+// Ordering priority: edge difference plus already-contracted neighbours,
+// which spreads contraction evenly over the graph
+static int contractionPriority(Contraction* state, int v) {
+    int shortcuts = contractNode(state, v);
+    return shortcuts - state->in[v].size - state->out[v].size + state->contractedNeighbors[v];
+}
+
+// Pack per-node arc lists into a CSR graph plus middles array
+static void packHierarchyArcs(CHArcList* lists, int n, CSRGraph* csr, int** middles) {
+    csr->nodeCount = n;
+    csr->offsets = (int*)malloc(((size_t)n + 1) * sizeof(int));
+    csr->offsets[0] = 0;
+    for (int v = 0; v < n; v++) {
+        csr->offsets[v + 1] = csr->offsets[v] + lists[v].size;
+    }
+    csr->edgeCount = csr->offsets[n];
+    csr->targets = (int*)malloc((csr->edgeCount > 0 ? csr->edgeCount : 1) * sizeof(int));
+    csr->weights = (int*)malloc((csr->edgeCount > 0 ? csr->edgeCount : 1) * sizeof(int));
+    *middles = (int*)malloc((csr->edgeCount > 0 ? csr->edgeCount : 1) * sizeof(int));
+    for (int v = 0; v < n; v++) {
+        for (int i = 0; i < lists[v].size; i++) {
+            int k = csr->offsets[v] + i;
+            csr->targets[k] = lists[v].arcs[i].node;
+            csr->weights[k] = lists[v].arcs[i].weight;
+            (*middles)[k] = lists[v].arcs[i].middle;
+        }
+    }
+}
+
+// Contract nodes one at a time in order of (lazily updated) priority, adding
+// shortcuts so distances among the remaining nodes are preserved. The arcs a
+// node still has when contracted all lead to higher-ranked nodes and form the
+// hierarchy. Weights must be non-negative.
+void buildContractionHierarchy(const CSRGraph* csr, ContractionHierarchy* ch) {
+    int n = csr->nodeCount;
+    Contraction state;
+    state.nodeCount = n;
+    state.out = (CHArcList*)calloc(n > 0 ? n : 1, sizeof(CHArcList));
+    state.in = (CHArcList*)calloc(n > 0 ? n : 1, sizeof(CHArcList));
+    state.contracted = (char*)calloc(n > 0 ? n : 1, sizeof(char));
+    state.contractedNeighbors = (int*)calloc(n > 0 ? n : 1, sizeof(int));
+    state.witness = createSearchSpace(n);
+    state.pending = NULL;
+    state.pendingCount = state.pendingCapacity = 0;
+
+    // Self loops never lie on a shortest path; parallel edges keep the lightest
+    for (int u = 0; u < n; u++) {
+        for (int k = csr->offsets[u]; k < csr->offsets[u + 1]; k++) {
+            int v = csr->targets[k];
+            if (v == u) continue;
+            arcListPut(&state.out[u], v, csr->weights[k], -1);
+            arcListPut(&state.in[v], u, csr->weights[k], -1);
+        }
+    }
+
+    CHArcList* upward = (CHArcList*)calloc(n > 0 ? n : 1, sizeof(CHArcList));
+    CHArcList* downward = (CHArcList*)calloc(n > 0 ? n : 1, sizeof(CHArcList));
+    ch->nodeCount = n;
+    ch->rank = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+
+    IndexedMinHeap* queue = createIndexedMinHeap(n > 0 ? n : 1);
+    for (int v = 0; v < n; v++) {
+        heapPushOrDecrease(queue, v, contractionPriority(&state, v));
+    }
+
+    int nextRank = 0;
+    while (queue->size > 0) {
+        int v = heapPopMin(queue);
+
+        // Lazy update: if v's priority went stale, requeue it and try the next node
+        int priority = contractionPriority(&state, v);
+        if (queue->size > 0 && priority > queue->keys[queue->nodes[0]]) {
+            heapPushOrDecrease(queue, v, priority);
+            continue;
+        }
+
+        // The priority evaluation just found v's shortcuts; insert them
+        for (int i = 0; i < state.pendingCount; i++) {
+            CHArc shortcut = state.pending[i];
+            arcListPut(&state.out[shortcut.node], shortcut.middle, shortcut.weight, v);
+            arcListPut(&state.in[shortcut.middle], shortcut.node, shortcut.weight, v);
+        }
+        ch->rank[v] = nextRank++;
+        state.contracted[v] = 1;
+
+        // v's remaining arcs all reach higher-ranked nodes; move them into the
+        // hierarchy and detach v from its neighbours
+        for (int i = 0; i < state.out[v].size; i++) {
+            CHArc arc = state.out[v].arcs[i];
+            arcListPut(&upward[v], arc.node, arc.weight, arc.middle);
+            arcListRemove(&state.in[arc.node], v);
+            state.contractedNeighbors[arc.node]++;
+        }
+        for (int i = 0; i < state.in[v].size; i++) {
+            CHArc arc = state.in[v].arcs[i];
+            arcListPut(&downward[v], arc.node, arc.weight, arc.middle);
+            arcListRemove(&state.out[arc.node], v);
+            state.contractedNeighbors[arc.node]++;
+        }
+        free(state.out[v].arcs);
+        free(state.in[v].arcs);
+        memset(&state.out[v], 0, sizeof(CHArcList));
+        memset(&state.in[v], 0, sizeof(CHArcList));
+    }
+
+    packHierarchyArcs(upward, n, &ch->upward, &ch->upwardMiddle);
+    packHierarchyArcs(downward, n, &ch->downward, &ch->downwardMiddle);
+
+    for (int v = 0; v < n; v++) {
+        free(upward[v].arcs);
+        free(downward[v].arcs);
+    }
+    free(upward);
+    free(downward);
+    freeIndexedMinHeap(queue);
+    freeSearchSpace(state.witness);
+    free(state.pending);
+    free(state.out);
+    free(state.in);
+    free(state.contracted);
+    free(state.contractedNeighbors);
+}
+
+void freeContractionHierarchy(ContractionHierarchy* ch) {
+    free(ch->rank);
+    free(ch->upwardMiddle);
+    free(ch->downwardMiddle);
+    freeCSR(&ch->upward);
+    freeCSR(&ch->downward);
+    ch->rank = ch->upwardMiddle = ch->downwardMiddle = NULL;
+    ch->nodeCount = 0;
+}
+
+// CSR arrays read from a file: offsets must start at 0, never decrease and
+// end at edgeCount, and every target must be a node id. One O(n + m) pass.
+static int validCSRArrays(const int* offsets, const int* targets, int nodeCount, int edgeCount) {
+    if (offsets[0] != 0 || offsets[nodeCount] != edgeCount) return 0;
+    for (int v = 0; v < nodeCount; v++) {
+        if (offsets[v] > offsets[v + 1]) return 0;
+    }
+    for (int k = 0; k < edgeCount; k++) {
+        if (!isValidNode(targets[k], nodeCount)) return 0;
+    }
+    return 1;
+}
+
+static int writeInts(FILE* file, const int* values, int count) {
+    return fwrite(values, sizeof(int), count, file) == (size_t)count;
+}
+
+static int readInts(FILE* file, int* values, int count) {
+    return fread(values, sizeof(int), count, file) == (size_t)count;
+}
+
+// File layout: "CHG1", uint32 version, uint32 node count, uint32 upward and
+// downward arc counts, int32 rank[n], then for upward and downward in turn
+// offsets[n + 1], targets, weights and middles. Returns 0 on an I/O error.
+int saveContractionHierarchy(const ContractionHierarchy* ch, const char* path) {
+    FILE* outputFile = fopen(path, "wb");
+    if (!outputFile) return 0;
+
+    uint32_t header[4] = {CH_VERSION, (uint32_t)ch->nodeCount, (uint32_t)ch->upward.edgeCount,
+                          (uint32_t)ch->downward.edgeCount};
+    int ok = fwrite(CH_MAGIC, 1, 4, outputFile) == 4 && fwrite(header, sizeof(uint32_t), 4, outputFile) == 4;
+    ok = ok && writeInts(outputFile, ch->rank, ch->nodeCount);
+    ok = ok && writeInts(outputFile, ch->upward.offsets, ch->nodeCount + 1);
+    ok = ok && writeInts(outputFile, ch->upward.targets, ch->upward.edgeCount);
+    ok = ok && writeInts(outputFile, ch->upward.weights, ch->upward.edgeCount);
+    ok = ok && writeInts(outputFile, ch->upwardMiddle, ch->upward.edgeCount);
+    ok = ok && writeInts(outputFile, ch->downward.offsets, ch->nodeCount + 1);
+    ok = ok && writeInts(outputFile, ch->downward.targets, ch->downward.edgeCount);
+    ok = ok && writeInts(outputFile, ch->downward.weights, ch->downward.edgeCount);
+    ok = ok && writeInts(outputFile, ch->downwardMiddle, ch->downward.edgeCount);
+    if (fclose(outputFile) != 0) ok = 0;
+    return ok;
+}
+
+static void allocateHierarchyArcs(CSRGraph* csr, int** middles, int n, int arcCount) {
+    csr->nodeCount = n;
+    csr->edgeCount = arcCount;
+    csr->offsets = (int*)malloc(((size_t)n + 1) * sizeof(int));
+    csr->targets = (int*)malloc((arcCount > 0 ? arcCount : 1) * sizeof(int));
+    csr->weights = (int*)malloc((arcCount > 0 ? arcCount : 1) * sizeof(int));
+    *middles = (int*)malloc((arcCount > 0 ? arcCount : 1) * sizeof(int));
+}
+
+// Every middle is -1 or a node id
+static int validHierarchyMiddles(const int* middles, int arcCount, int nodeCount) {
+    for (int k = 0; k < arcCount; k++) {
+        if (middles[k] != -1 && !isValidNode(middles[k], nodeCount)) return 0;
+    }
+    return 1;
+}
+
+// Load a hierarchy written by saveContractionHierarchy. The header must match
+// the file size before anything is allocated, and the arcs are checked like a
+// graph image's so queries stay in bounds. Returns 0 on failure.
+int loadContractionHierarchy(const char* path, ContractionHierarchy* ch) {
+    FILE* inputFile = fopen(path, "rb");
+    if (!inputFile) return 0;
+
+    char magic[4];
+    uint32_t header[4];
+    if (fread(magic, 1, 4, inputFile) != 4 || memcmp(magic, CH_MAGIC, 4) != 0 ||
+        fread(header, sizeof(uint32_t), 4, inputFile) != 4 || header[0] != CH_VERSION ||
+        header[1] > INT_MAX - 1 || header[2] > INT_MAX || header[3] > INT_MAX) {
+        fclose(inputFile);
+        return 0;
+    }
+    uint64_t intCount = 3 * (uint64_t)header[1] + 2 + 3 * ((uint64_t)header[2] + header[3]);
+    long dataStart = ftell(inputFile);
+    if (fseek(inputFile, 0, SEEK_END) != 0 || (uint64_t)(ftell(inputFile) - dataStart) != intCount * sizeof(int) ||
+        fseek(inputFile, dataStart, SEEK_SET) != 0) {
+        fclose(inputFile);
+        return 0;
+    }
+
+    int n = (int)header[1];
+    ch->nodeCount = n;
+    ch->rank = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    allocateHierarchyArcs(&ch->upward, &ch->upwardMiddle, n, (int)header[2]);
+    allocateHierarchyArcs(&ch->downward, &ch->downwardMiddle, n, (int)header[3]);
+
+    int ok = readInts(inputFile, ch->rank, n);
+    ok = ok && readInts(inputFile, ch->upward.offsets, n + 1);
+    ok = ok && readInts(inputFile, ch->upward.targets, ch->upward.edgeCount);
+    ok = ok && readInts(inputFile, ch->upward.weights, ch->upward.edgeCount);
+    ok = ok && readInts(inputFile, ch->upwardMiddle, ch->upward.edgeCount);
+    ok = ok && readInts(inputFile, ch->downward.offsets, n + 1);
+    ok = ok && readInts(inputFile, ch->downward.targets, ch->downward.edgeCount);
+    ok = ok && readInts(inputFile, ch->downward.weights, ch->downward.edgeCount);
+    ok = ok && readInts(inputFile, ch->downwardMiddle, ch->downward.edgeCount);
+    fclose(inputFile);
+    ok = ok && validCSRArrays(ch->upward.offsets, ch->upward.targets, n, ch->upward.edgeCount) &&
+         validCSRArrays(ch->downward.offsets, ch->downward.targets, n, ch->downward.edgeCount) &&
+         validHierarchyMiddles(ch->upwardMiddle, ch->upward.edgeCount, n) &&
+         validHierarchyMiddles(ch->downwardMiddle, ch->downward.edgeCount, n);
+
+    if (!ok) freeContractionHierarchy(ch);
+    return ok;
+}
+
+// Bidirectional upward search: the forward search only climbs upward arcs
+// from source and the backward search only climbs downward arcs from target.
+// Each side stops once its smallest key reaches the best meeting distance.
+int hierarchyQuery(const ContractionHierarchy* ch, int source, int target,
+                   SearchSpace* forward, SearchSpace* backward, int* meeting) {
+    beginSearch(forward);
+    beginSearch(backward);
+    searchSet(forward, source, 0, -1);
+    searchSet(backward, target, 0, -1);
+    heapPushOrDecrease(forward->heap, source, 0);
+    heapPushOrDecrease(backward->heap, target, 0);
+
+    long long best = INT_MAX;
+    *meeting = -1;
+
+    while (1) {
+        int forwardActive = forward->heap->size > 0 && forward->heap->keys[forward->heap->nodes[0]] < best;
+        int backwardActive = backward->heap->size > 0 && backward->heap->keys[backward->heap->nodes[0]] < best;
+        if (!forwardActive && !backwardActive) break;
+
+        int expandForward = forwardActive &&
+            (!backwardActive || forward->heap->keys[forward->heap->nodes[0]] <= backward->heap->keys[backward->heap->nodes[0]]);
+        SearchSpace* side = expandForward ? forward : backward;
+        SearchSpace* other = expandForward ? backward : forward;
+        const CSRGraph* arcs = expandForward ? &ch->upward : &ch->downward;
+
+        int u = heapPopMin(side->heap);
+        int du = side->distances[u];
+        int otherDistance = searchDistance(other, u);
+        if (otherDistance != INT_MAX && (long long)du + otherDistance < best) {
+            best = (long long)du + otherDistance;
+            *meeting = u;
+        }
+
+        for (int k = arcs->offsets[u]; k < arcs->offsets[u + 1]; k++) {
+            int v = arcs->targets[k];
+            int candidate = du + arcs->weights[k];
+            if (candidate < searchDistance(side, v)) {
+                searchSet(side, v, candidate, u);
+                heapPushOrDecrease(side->heap, v, candidate);
+            }
+        }
+    }
+    return *meeting == -1 ? INT_MAX : (int)best;
+}
+
+// Middle node of the hierarchy arc from -> to (stored at from in upward when
+// rank[to] > rank[from], else at to in downward), or -1 for an original edge
+static int hierarchyArcMiddle(const ContractionHierarchy* ch, int from, int to) {
+    const CSRGraph* arcs = ch->rank[to] > ch->rank[from] ? &ch->upward : &ch->downward;
+    const int* middles = ch->rank[to] > ch->rank[from] ? ch->upwardMiddle : ch->downwardMiddle;
+    int owner = ch->rank[to] > ch->rank[from] ? from : to;
+    int other = owner == from ? to : from;
+    for (int k = arcs->offsets[owner]; k < arcs->offsets[owner + 1]; k++) {
+        if (arcs->targets[k] == other) return middles[k];
+    }
+    return -1;
+}
+
+// Append the original edges behind arc from -> to (excluding from itself)
+static int unpackHierarchyArc(const ContractionHierarchy* ch, int from, int to, int* path, int length) {
+    int middle = hierarchyArcMiddle(ch, from, to);
+    if (middle == -1) {
+        path[length++] = to;
+        return length;
+    }
+    length = unpackHierarchyArc(ch, from, middle, path, length);
+    return unpackHierarchyArc(ch, middle, to, path, length);
+}
+
+// Expand the path found by hierarchyQuery into original edges. Returns the
+// node count of the path source .. target, or 0 if there is none.
+int hierarchyPath(const ContractionHierarchy* ch, const SearchSpace* forward, const SearchSpace* backward,
+                  int meeting, int* path) {
+    if (meeting == -1) return 0;
+
+    // Hierarchy nodes from source up to the meeting node, then down to target
+    int hops = tracePath(forward, meeting, path);
+    int* chain = (int*)malloc(((size_t)ch->nodeCount + 1) * sizeof(int));
+    memcpy(chain, path, hops * sizeof(int));
+    for (int v = backward->prev[meeting]; v != -1; v = backward->prev[v]) {
+        chain[hops++] = v;
+    }
+
+    int length = 0;
+    path[length++] = chain[0];
+    for (int i = 0; i + 1 < hops; i++) {
+        length = unpackHierarchyArc(ch, chain[i], chain[i + 1], path, length);
+    }
+    free(chain);
+    return length;
+}
+
+// Build a hierarchy for the current graph, answer one query with an unpacked
+// path, and compare query times against target-aware heap Dijkstra
+void contractionHierarchyMenu(Graph* graph, int source) {
+    int target;
+    printf(BLUE "Enter target node (0-%d): " RESET, graph->nodeCount - 1);
+    scanf("%d", &target);
+    if (!isValidNode(target, graph->nodeCount)) {
+        printf(RED "Invalid target node.\n" RESET);
+        return;
+    }
+
+    CSRGraph csr;
+    buildCSR(graph, &csr);
+    for (int k = 0; k < csr.edgeCount; k++) {
+        if (csr.weights[k] < 0) {
+            printf(RED "Negative weight found. Contraction hierarchies can't work with negative weights.\n" RESET);
+            freeCSR(&csr);
+            return;
+        }
+    }
+
+    ContractionHierarchy ch;
+    double start = nowSeconds();
+    buildContractionHierarchy(&csr, &ch);
+    double built = nowSeconds();
+
+    int n = csr.nodeCount;
+    SearchSpace* forward = createSearchSpace(n);
+    SearchSpace* backward = createSearchSpace(n);
+    int* path = (int*)malloc((n + 1) * sizeof(int));
+    int meeting, settled;
+
+    printDivider();
+    printf(GREEN "Contraction hierarchy built in %.3f s: %d upward + %d downward arcs for %d original edges.\n" RESET,
+           built - start, ch.upward.edgeCount, ch.downward.edgeCount, csr.edgeCount);
+
+    int distance = hierarchyQuery(&ch, source, target, forward, backward, &meeting);
+    if (distance == INT_MAX) {
+        printf("Node %d is unreachable from node %d.\n", target, source);
+    } else {
+        int length = hierarchyPath(&ch, forward, backward, meeting, path);
+        printf("Distance from %d to %d: %d\nPath: ", source, target, distance);
+        for (int i = 0; i < length; i++) {
+            printf(i == 0 ? "%d" : " -> %d", path[i]);
+        }
+        printf("\n");
+    }
+
+    // Random query benchmark with a fixed seed so runs are comparable
+    srand(42);
+    int* sources = (int*)malloc(CH_BENCHMARK_QUERIES * sizeof(int));
+    int* targets = (int*)malloc(CH_BENCHMARK_QUERIES * sizeof(int));
+    int* expected = (int*)malloc(CH_BENCHMARK_QUERIES * sizeof(int));
+    for (int q = 0; q < CH_BENCHMARK_QUERIES; q++) {
+        sources[q] = rand() % n;
+        targets[q] = rand() % n;
+    }
+
+    double dijkstraStart = nowSeconds();
+    for (int q = 0; q < CH_BENCHMARK_QUERIES; q++) {
+        expected[q] = dijkstraToTarget(&csr, sources[q], targets[q], forward, &settled);
+    }
+    double hierarchyStart = nowSeconds();
+    int mismatches = 0;
+    for (int q = 0; q < CH_BENCHMARK_QUERIES; q++) {
+        if (hierarchyQuery(&ch, sources[q], targets[q], forward, backward, &meeting) != expected[q]) {
+            mismatches++;
+        }
+    }
+    double finished = nowSeconds();
+
+    double dijkstraMicros = (hierarchyStart - dijkstraStart) * 1e6 / CH_BENCHMARK_QUERIES;
+    double hierarchyMicros = (finished - hierarchyStart) * 1e6 / CH_BENCHMARK_QUERIES;
+    printf("%d random queries: Dijkstra %.2f us/query, hierarchy %.2f us/query (%.1fx).\n",
+           CH_BENCHMARK_QUERIES, dijkstraMicros, hierarchyMicros,
+           hierarchyMicros > 0 ? dijkstraMicros / hierarchyMicros : 0.0);
+    if (mismatches == 0) {
+        printf(GREEN "Verified: all hierarchy distances match Dijkstra's algorithm.\n" RESET);
+    } else {
+        printf(RED "%d hierarchy distance(s) differ from Dijkstra's algorithm.\n" RESET, mismatches);
+    }
+
+    char outputPath[256];
+    printf(BLUE "Enter a path to save the hierarchy, or '-' to skip: " RESET);
+    scanf("%255s", outputPath);
+    if (strcmp(outputPath, "-") != 0) {
+        if (saveContractionHierarchy(&ch, outputPath)) {
+            printf(GREEN "Hierarchy saved to %s\n" RESET, outputPath);
+        } else {
+            printf(RED "Error writing hierarchy: %s\n" RESET, outputPath);
+        }
+    }
+    printDivider();
+
+    free(sources);
+    free(targets);
+    free(expected);
+    free(path);
+    freeSearchSpace(forward);
+    freeSearchSpace(backward);
+    freeContractionHierarchy(&ch);
+    freeCSR(&csr);
+}
+
+static void treeDetach(DynamicShortestPaths* dsp, int v) {
+    int parent = dsp->prev[v];
+    if (parent == -1) return;
+    if (dsp->prevSibling[v] != -1) {
+        dsp->nextSibling[dsp->prevSibling[v]] = dsp->nextSibling[v];
+    } else {
+        dsp->firstChild[parent] = dsp->nextSibling[v];
+    }
+    if (dsp->nextSibling[v] != -1) {
+        dsp->prevSibling[dsp->nextSibling[v]] = dsp->prevSibling[v];
+    }
+    dsp->prev[v] = dsp->nextSibling[v] = dsp->prevSibling[v] = -1;
+}
+
+static void treeSetParent(DynamicShortestPaths* dsp, int v, int parent) {
+    treeDetach(dsp, v);
+    dsp->prev[v] = parent;
+    if (parent == -1) return;
+    dsp->prevSibling[v] = -1;
+    dsp->nextSibling[v] = dsp->firstChild[parent];
+    if (dsp->firstChild[parent] != -1) {
+        dsp->prevSibling[dsp->firstChild[parent]] = v;
+    }
+    dsp->firstChild[parent] = v;
+}
+
+// Compute the initial tree with SPFA. Returns NULL if the graph has a
+// negative cycle reachable from source.
+DynamicShortestPaths* createDynamicShortestPaths(Graph* graph, int source) {
+    int n = graph->nodeCount;
+    CSRGraph csr;
+    buildCSR(graph, &csr);
+    int* distances = (int*)malloc(n * sizeof(int));
+    int* prev = (int*)malloc(n * sizeof(int));
+    int* cycle = (int*)malloc(n * sizeof(int));
+    int cycleLength = spfaDistances(&csr, source, distances, prev, cycle);
+    free(cycle);
+    freeCSR(&csr);
+    if (cycleLength > 0) {
+        free(distances);
+        free(prev);
+        return NULL;
+    }
+
+    DynamicShortestPaths* dsp = (DynamicShortestPaths*)calloc(1, sizeof(DynamicShortestPaths));
+    dsp->graph = graph;
+    dsp->source = source;
+    dsp->nodeCount = n;
+    dsp->distances = distances;
+    dsp->prev = (int*)malloc(n * sizeof(int));
+    dsp->firstChild = (int*)malloc(n * sizeof(int));
+    dsp->nextSibling = (int*)malloc(n * sizeof(int));
+    dsp->prevSibling = (int*)malloc(n * sizeof(int));
+    dsp->stamp = (int*)calloc(n, sizeof(int));
+    dsp->heap = createIndexedMinHeap(n);
+    for (int v = 0; v < n; v++) {
+        dsp->prev[v] = dsp->firstChild[v] = dsp->nextSibling[v] = dsp->prevSibling[v] = -1;
+    }
+    for (int v = 0; v < n; v++) {
+        treeSetParent(dsp, v, prev[v]);
+    }
+    free(prev);
+
+    initGraph(&dsp->reverse, n);
+    for (int u = 0; u < n; u++) {
+        for (Edge* edge = graph->adjacencyList[u]; edge != NULL; edge = edge->next) {
+            addEdge(&dsp->reverse, edge->destination, u, edge->weight);
+        }
+    }
+    return dsp;
+}
+
+void freeDynamicShortestPaths(DynamicShortestPaths* dsp) {
+    freeGraph(&dsp->reverse);
+    freeIndexedMinHeap(dsp->heap);
+    free(dsp->distances);
+    free(dsp->prev);
+    free(dsp->firstChild);
+    free(dsp->nextSibling);
+    free(dsp->prevSibling);
+    free(dsp->stamp);
+    free(dsp->changed.data);
+    free(dsp);
+}
+
+// Undo log entry for a distance change that may have to be rolled back
+typedef struct DistanceChange {
+    int node;
+    int distance;
+    int prev;
+} DistanceChange;
+
+static void logDistanceChange(DistanceChange** log, int* size, int* capacity,
+                              const DynamicShortestPaths* dsp, int node) {
+    if (*size == *capacity) {
+        *capacity = *capacity > 0 ? *capacity * 2 : 64;
+        *log = (DistanceChange*)realloc(*log, (size_t)*capacity * sizeof(DistanceChange));
+    }
+    (*log)[*size].node = node;
+    (*log)[*size].distance = dsp->distances[node];
+    (*log)[*size].prev = dsp->prev[node];
+    (*size)++;
+}
+
+static int isTreeAncestor(const DynamicShortestPaths* dsp, int ancestor, int node) {
+    for (int x = node; x != -1; x = dsp->prev[x]) {
+        if (x == ancestor) return 1;
+    }
+    return 0;
+}
+
+// Propagate a shorter distance for v (reached over u -> v) to everything below
+// it. A node improving that is already above the relaxing node in the tree
+// (including u and its ancestors) closes a negative cycle; the changes are then
+// rolled back and 0 returned.
+static int propagateDecrease(DynamicShortestPaths* dsp, int u, int v, int distance) {
+    DistanceChange* log = NULL;
+    int logSize = 0, logCapacity = 0;
+    int ok = 1;
+
+    int aboveStamp = ++dsp->currentStamp;
+    int improvedStamp = ++dsp->currentStamp;
+    for (int x = u; x != -1; x = dsp->prev[x]) {
+        dsp->stamp[x] = aboveStamp;
+    }
+    if (dsp->stamp[v] == aboveStamp) return 0;
+
+    heapClear(dsp->heap);
+    dsp->changed.size = 0;
+    logDistanceChange(&log, &logSize, &logCapacity, dsp, v);
+    dsp->stamp[v] = improvedStamp;
+    dsp->distances[v] = distance;
+    treeSetParent(dsp, v, u);
+    heapPushOrDecrease(dsp->heap, v, distance);
+
+    while (ok && dsp->heap->size > 0) {
+        int x = heapPopMin(dsp->heap);
+        for (Edge* edge = dsp->graph->adjacencyList[x]; edge != NULL; edge = edge->next) {
+            int y = edge->destination;
+            int candidate = dsp->distances[x] + edge->weight;
+            if (candidate >= dsp->distances[y]) continue;
+            if (dsp->stamp[y] == aboveStamp ||
+                (dsp->stamp[y] == improvedStamp && isTreeAncestor(dsp, y, x))) {
+                ok = 0;
+                break;
+            }
+            logDistanceChange(&log, &logSize, &logCapacity, dsp, y);
+            dsp->stamp[y] = improvedStamp;
+            dsp->distances[y] = candidate;
+            treeSetParent(dsp, y, x);
+            heapPushOrDecrease(dsp->heap, y, candidate);
+        }
+    }
+
+    if (!ok) {
+        for (int i = logSize - 1; i >= 0; i--) {
+            dsp->distances[log[i].node] = log[i].distance;
+            treeSetParent(dsp, log[i].node, log[i].prev);
+        }
+        heapClear(dsp->heap);
+    } else {
+        for (int i = 0; i < logSize; i++) {
+            if (dsp->stamp[log[i].node] != improvedStamp) continue;
+            dsp->stamp[log[i].node] = 0;
+            intVectorPush(&dsp->changed, log[i].node);
+        }
+    }
+    free(log);
+    return ok;
+}
+
+// The tree edge into v got longer or vanished: drop v's subtree, give every
+// node in it the best distance through an incoming edge from outside, then run
+// Dijkstra inside the subtree. Nodes elsewhere cannot change.
+static void repairSubtree(DynamicShortestPaths* dsp, int v) {
+    IntVector subtree = {0};
+    IntVector stack = {0};
+    dsp->currentStamp++;
+    dsp->changed.size = 0;
+
+    intVectorPush(&stack, v);
+    while (stack.size > 0) {
+        int x = stack.data[--stack.size];
+        intVectorPush(&subtree, x);
+        dsp->stamp[x] = dsp->currentStamp;
+        for (int child = dsp->firstChild[x]; child != -1; child = dsp->nextSibling[child]) {
+            intVectorPush(&stack, child);
+        }
+    }
+
+    for (int i = 0; i < subtree.size; i++) {
+        int x = subtree.data[i];
+        treeDetach(dsp, x);
+        dsp->distances[x] = INT_MAX;
+    }
+
+    heapClear(dsp->heap);
+    for (int i = 0; i < subtree.size; i++) {
+        int x = subtree.data[i];
+        int best = INT_MAX, bestParent = -1;
+        for (Edge* edge = dsp->reverse.adjacencyList[x]; edge != NULL; edge = edge->next) {
+            int y = edge->destination;
+            if (dsp->stamp[y] == dsp->currentStamp || dsp->distances[y] == INT_MAX) continue;
+            if (dsp->distances[y] + edge->weight < best) {
+                best = dsp->distances[y] + edge->weight;
+                bestParent = y;
+            }
+        }
+        if (bestParent != -1) {
+            dsp->distances[x] = best;
+            treeSetParent(dsp, x, bestParent);
+            heapPushOrDecrease(dsp->heap, x, best);
+        }
+    }
+
+    while (dsp->heap->size > 0) {
+        int x = heapPopMin(dsp->heap);
+        for (Edge* edge = dsp->graph->adjacencyList[x]; edge != NULL; edge = edge->next) {
+            int y = edge->destination;
+            int candidate = dsp->distances[x] + edge->weight;
+            if (candidate < dsp->distances[y]) {
+                dsp->distances[y] = candidate;
+                treeSetParent(dsp, y, x);
+                heapPushOrDecrease(dsp->heap, y, candidate);
+            }
+        }
+    }
+
+    for (int i = 0; i < subtree.size; i++) {
+        intVectorPush(&dsp->changed, subtree.data[i]);
+    }
+    free(subtree.data);
+    free(stack.data);
+}
+
+// Shorter edge u -> v: propagate if it improves v. Returns 0 if it closes a
+// negative cycle, in which case distances are left as they were.
+static int applyDecrease(DynamicShortestPaths* dsp, int u, int v, int weight) {
+    dsp->changed.size = 0;
+    if (dsp->distances[u] == INT_MAX || dsp->distances[u] + weight >= dsp->distances[v]) return 1;
+    return propagateDecrease(dsp, u, v, dsp->distances[u] + weight);
+}
+
+// Add edge u -> v and repair the tree. Returns 1 on success, -1 (and leaves the
+// graph unchanged) if the edge would close a negative cycle.
+int dynamicInsertEdge(DynamicShortestPaths* dsp, int u, int v, int weight) {
+    if (!applyDecrease(dsp, u, v, weight)) return -1;
+    addEdge(dsp->graph, u, v, weight);
+    addEdge(&dsp->reverse, v, u, weight);
+    return 1;
+}
+
+// Remove edge u -> v and repair the tree. Returns 0 if there is no such edge.
+int dynamicDeleteEdge(DynamicShortestPaths* dsp, int u, int v) {
+    Edge** link = findEdgeLink(dsp->graph, u, v, NULL);
+    if (link == NULL) return 0;
+    // Parallel edges may differ in weight, so drop the matching reverse copy
+    unlinkEdge(&dsp->reverse, findEdgeLink(&dsp->reverse, v, u, &(*link)->weight));
+    unlinkEdge(dsp->graph, link);
+    dsp->changed.size = 0;
+    if (dsp->prev[v] == u) {
+        repairSubtree(dsp, v);
+    }
+    return 1;
+}
+
+// Change the weight of edge u -> v and repair the tree. Returns 0 if there is
+// no such edge and -1 (leaving the weight unchanged) if the new weight would
+// close a negative cycle.
+int dynamicSetWeight(DynamicShortestPaths* dsp, int u, int v, int weight) {
+    Edge* edge = findEdge(dsp->graph, u, v);
+    if (edge == NULL) return 0;
+    int oldWeight = edge->weight;
+    Edge* reverseEdge = *findEdgeLink(&dsp->reverse, v, u, &oldWeight);
+
+    if (weight < oldWeight) {
+        if (!applyDecrease(dsp, u, v, weight)) return -1;
+        edge->weight = reverseEdge->weight = weight;
+        dsp->graph->version++;
+    } else {
+        edge->weight = reverseEdge->weight = weight;
+        dsp->graph->version++;
+        dsp->changed.size = 0;
+        if (weight > oldWeight && dsp->prev[v] == u) {
+            repairSubtree(dsp, v);
+        }
+    }
+    return 1;
+}
+
+// Stream of edge updates against the shortest-path tree of the current source
+void dynamicUpdatesMenu(Graph* graph, int source) {
+    DynamicShortestPaths* dsp = createDynamicShortestPaths(graph, source);
+    if (dsp == NULL) {
+        printf(RED "Graph contains a negative weight cycle.\n" RESET);
+        return;
+    }
+    printShortestPaths(CYAN, "Dynamic", source, dsp->distances, dsp->prev, dsp->nodeCount);
+
+    while (1) {
+        printf(BLUE "Choose an update:\n" RESET);
+        printf("1. Insert edge\n");
+        printf("2. Delete edge\n");
+        printf("3. Change edge weight\n");
+        printf("4. Show shortest paths\n");
+        printf("5. Go back\n");
+        printf(BLUE "Enter your choice (1-5): " RESET);
+        int choice, u, v, weight = 0;
+        scanf("%d", &choice);
+
+        if (choice == 4) {
+            printShortestPaths(CYAN, "Dynamic", source, dsp->distances, dsp->prev, dsp->nodeCount);
+            continue;
+        } else if (choice == 5) {
+            break;
+        } else if (choice < 1 || choice > 5) {
+            printf(RED "Invalid choice.\n" RESET);
+            continue;
+        }
+
+        if (choice == 2) {
+            printf(BLUE "Enter the edge as 'source_node' 'destination_node': " RESET);
+            scanf("%d %d", &u, &v);
+        } else {
+            printf(BLUE "Enter the edge as 'source_node' 'destination_node' 'weight': " RESET);
+            scanf("%d %d %d", &u, &v, &weight);
+        }
+        if (!isValidNode(u, dsp->nodeCount) || !isValidNode(v, dsp->nodeCount)) {
+            printf(RED "Invalid edge input. Ensure nodes are valid.\n" RESET);
+            continue;
+        }
+
+        int result;
+        if (choice == 1) {
+            result = dynamicInsertEdge(dsp, u, v, weight);
+        } else if (choice == 2) {
+            result = dynamicDeleteEdge(dsp, u, v);
+        } else {
+            result = dynamicSetWeight(dsp, u, v, weight);
+        }
+
+        if (result == 0) {
+            printf(RED "No edge %d -> %d in the graph.\n" RESET, u, v);
+        } else if (result < 0) {
+            printf(RED "Rejected: that update would create a negative weight cycle.\n" RESET);
+        } else {
+            printf(GREEN "Update applied; %d node(s) repaired.\n" RESET, dsp->changed.size);
+        }
+    }
+
+    freeDynamicShortestPaths(dsp);
+}
+
+ShortestPathTree* createShortestPathTree(int source, int nodeCount) {
+    ShortestPathTree* tree = (ShortestPathTree*)malloc(sizeof(ShortestPathTree));
+    tree->source = source;
+    tree->nodeCount = nodeCount;
+    tree->distances = (int*)malloc(nodeCount * sizeof(int));
+    tree->prev = (int*)malloc(nodeCount * sizeof(int));
+    return tree;
+}
+
+void freeShortestPathTree(ShortestPathTree* tree) {
+    if (tree == NULL) return;
+    free(tree->distances);
+    free(tree->prev);
+    free(tree);
+}
+
+// Write the path source -> ... -> target into path (room for nodeCount entries)
+// in O(path length). Returns the number of nodes, or 0 if target is unreachable.
+int shortestPathTo(const ShortestPathTree* tree, int target, int* path) {
+    if (tree->distances[target] == INT_MAX) return 0;
+    int length = 0;
+    for (int v = target; v != -1; v = tree->prev[v]) {
+        length++;
+    }
+    int i = length;
+    for (int v = target; v != -1; v = tree->prev[v]) {
+        path[--i] = v;
+    }
+    return length;
+}
+
+void initShortestPathCache(ShortestPathCache* cache) {
+    memset(cache, 0, sizeof(ShortestPathCache));
+}
+
+void clearShortestPathCache(ShortestPathCache* cache) {
+    for (int i = 0; i < cache->size; i++) {
+        freeShortestPathTree(cache->entries[i].tree);
+    }
+    cache->size = 0;
+}
+
+// Drop every entry if they were computed for another graph or an older version
+static void validateShortestPathCache(ShortestPathCache* cache, const Graph* graph) {
+    if (cache->graph != graph || cache->graphVersion != graph->version) {
+        clearShortestPathCache(cache);
+        cache->graph = graph;
+        cache->graphVersion = graph->version;
+    }
+}
+
+// Return the cached tree for (algorithm, source), or NULL on a miss. The tree
+// stays owned by the cache and is valid until the next insert or clear.
+ShortestPathTree* cacheLookup(ShortestPathCache* cache, const Graph* graph, ShortestPathAlgorithm algorithm, int source) {
+    if (cache == NULL) return NULL;
+    validateShortestPathCache(cache, graph);
+    for (int i = 0; i < cache->size; i++) {
+        TreeCacheEntry* entry = &cache->entries[i];
+        if (entry->algorithm == algorithm && entry->tree->source == source) {
+            entry->lastUsed = ++cache->clock;
+            cache->hits++;
+            return entry->tree;
+        }
+    }
+    cache->misses++;
+    return NULL;
+}
+
+// Hand a freshly computed tree to the cache, evicting the least recently used
+// entry when full. Without a cache the tree is returned as-is and the caller
+// keeps it; with one the returned pointer follows cacheLookup's rules.
+ShortestPathTree* cacheInsert(ShortestPathCache* cache, const Graph* graph, ShortestPathAlgorithm algorithm,
+                              ShortestPathTree* tree) {
+    if (cache == NULL) return tree;
+    validateShortestPathCache(cache, graph);
+    int slot = cache->size;
+    if (cache->size == SHORTEST_PATH_CACHE_SIZE) {
+        slot = 0;
+        for (int i = 1; i < cache->size; i++) {
+            if (cache->entries[i].lastUsed < cache->entries[slot].lastUsed) slot = i;
+        }
+        freeShortestPathTree(cache->entries[slot].tree);
+    } else {
+        cache->size++;
+    }
+    cache->entries[slot].algorithm = algorithm;
+    cache->entries[slot].tree = tree;
+    cache->entries[slot].lastUsed = ++cache->clock;
+    return tree;
+}
+
+// Print one source-to-target path using the cached queue-based Bellman-Ford
+// tree, so repeated targets for the same source cost only the path walk
+void pathToTarget(Graph* graph, int source, ShortestPathCache* cache) {
+    int target;
+    printf(BLUE "Enter target node (0-%d): " RESET, graph->nodeCount - 1);
+    scanf("%d", &target);
+    if (!isValidNode(target, graph->nodeCount)) {
+        printf(RED "Invalid target node.\n" RESET);
+        return;
+    }
+
+    int hitsBefore = cache->hits;
+    ShortestPathTree* tree = queueBellmanFordTree(graph, source, cache);
+    if (tree == NULL) return;
+
+    int* path = (int*)malloc(tree->nodeCount * sizeof(int));
+    int length = shortestPathTo(tree, target, path);
+    printDivider();
+    if (length == 0) {
+        printf(RED "Node %d is unreachable from node %d.\n" RESET, target, source);
+    } else {
+        printf(GREEN "Distance %d -> %d: %d\n" RESET, source, target, tree->distances[target]);
+        printf("Path: ");
+        for (int i = 0; i < length; i++) {
+            printf(i + 1 < length ? "%d -> " : "%d\n", path[i]);
+        }
+    }
+    printf("Tree for source %d %s (cache: %d hit(s), %d miss(es)).\n", source,
+           cache->hits > hitsBefore ? "served from cache" : "computed", cache->hits, cache->misses);
+    printDivider();
+    free(path);
+}
+
+// Print the distance table and the path from the source to every vertex.
+// Each path comes from shortestPathTo in O(path length) through one buffer.
+void printShortestPaths(const char* color, const char* algorithmName, int source,
+                        const int* distances, const int* prev, int nodeCount) {
+    ShortestPathTree tree = {source, nodeCount, (int*)distances, (int*)prev};
+    int* path = (int*)malloc((nodeCount > 0 ? nodeCount : 1) * sizeof(int));
+    printDivider();
+    printf("%s%s shortest paths from node %d (source):\n" RESET, color, algorithmName, source);
+    printf("Vertex\tDistance from Source\tPath\n");
+    for (int i = 0; i < nodeCount; i++) {
+        printf("%d\t\t", i);
+        int length = shortestPathTo(&tree, i, path);
+        if (length == 0) {
+            printf("Unreachable\t\t");
+            printf("No path\n");
+            continue;
+        }
+        printf("%d\t\t\t", distances[i]);
+
+        printf("Path: ");
+        for (int k = 0; k < length; k++) {
+            printf(k + 1 < length ? "%d -> " : "%d\n", path[k]);
+        }
+    }
+    printDivider();
+    free(path);
+}
+
+// Release the arena slabs and adjacency heads
+void freeGraph(Graph* graph) {
+    EdgeSlab* slab = graph->firstSlab;
+    while (slab != NULL) {
+        EdgeSlab* temp = slab;
+        slab = slab->next;
+        free(temp);
+    }
+    free(graph->adjacencyList);
+    memset(graph, 0, sizeof(Graph));
+}
+
+void printDivider() {
+    printf(YELLOW "--------------------------------------\n" RESET);
+}
+
+int isValidNode(int node, int maxNodes) {
+    return node >= 0 && node < maxNodes;
+}
+
+void printSampleGraph() {
+    printf(MAGENTA "Sample Graph (5 nodes: 0-1-2-3-4)\n" RESET);
+    printf("       Edges:\n");
+    printf("0 -> 1 (10)\n");
+    printf("0 -> 3 (5)\n");
+    printf("1 -> 2 (1)\n");
+    printf("2 -> 4 (4)\n");
+    printf("3 -> 1 (3)\n");
+    printf("3 -> 2 (9)\n");
+    printf("3 -> 4 (2)\n");
+    printf("4 -> 0 (7)\n");
+    printf("4 -> 2 (-2)\n");
+    printDivider();
+}
+void promptUserForGraph(Graph* graph) {
+    int nodes, edges, u, v, weight;
+
+    printf(BLUE "Enter the number of nodes: " RESET);
+    scanf("%d", &nodes);
+    if (nodes <= 0) {
+        printf(RED "Invalid number of nodes.\n" RESET);
+        return;
+    }
+    initGraph(graph, nodes);
+
+    printf(BLUE "Enter the number of edges: " RESET);
+    scanf("%d", &edges);
+    printf(YELLOW "Enter the details for each edge:\n" RESET);
+    printf(YELLOW "Format: 'source_node' 'destination_node' 'weight'\n" RESET);
+    printf(YELLOW "Example: 0 1 5 (indicates an edge from node 0 to node 1 with a weight of 5)\n" RESET);
+
+    for (int i = 0; i < edges; i++) {
+        printf(BLUE "Please enter edge %d: " RESET, i + 1);
+        if (scanf("%d %d %d", &u, &v, &weight) != 3) {
+            printf(RED "Invalid input. Please enter three integers.\n" RESET);
+            i--; // Repeat this iteration
+            while (getchar() != '\n'); // Clear the invalid input
+            continue; // Skip to the next iteration
+        }
+        if (isValidNode(u, nodes) && isValidNode(v, nodes)) {
+            addEdge(graph, u, v, weight);
+        } else {
+            printf(RED "Invalid edge input. Ensure nodes are valid.\n" RESET);
+            i--; // Repeat this iteration
+        }
+    }
+
+    // Display the graph
+    printf(MAGENTA "Graph connections:\n" RESET);
+    for (int i = 0; i < nodes; i++) {
+        Edge* edge = graph->adjacencyList[i];
+        while (edge) {
+            printf("%d -> %d (%d)\n", i, edge->destination, edge->weight);
+            edge = edge->next;
+        }
+    }
+    printDivider();
+
+    // Choose a source node
+    int source;
+    printf(BLUE "Enter source node (0-%d): " RESET, nodes - 1);
+    scanf("%d", &source);
+    if (!isValidNode(source, nodes)) {
+        printf(RED "Invalid source node.\n" RESET);
+        return;
+    }
+
+    algorithmMenu(graph, source);
+}
+
+// Algorithm selection loop with changing source option
+void algorithmMenu(Graph* graph, int source) {
+    ShortestPathCache cache;
+    initShortestPathCache(&cache);
+
+    while (1) {
+        printf(BLUE "Choose the algorithm to use:\n" RESET);
+        printf("1. Dijkstra's Algorithm\n");
+        printf("2. Bellman-Ford Algorithm\n");
+        printf("3. Dijkstra's Algorithm (binary heap)\n");
+        printf("4. Bellman-Ford Algorithm (queue-based, SPFA)\n");
+        printf("5. Delta-stepping (parallel)\n");
+        printf("6. All-pairs shortest paths (Johnson's)\n");
+        printf("7. Point-to-point query (early stop, bidirectional, A*)\n");
+        printf("8. Contraction hierarchy (build, query, benchmark)\n");
+        printf("9. Dynamic edge updates (incremental repair)\n");
+        printf("10. Path to a target node (cached trees)\n");
+        printf("11. Change Source Node\n");
+        printf("12. Go back to main menu\n");
+        printf(BLUE "Enter your choice (1-12): " RESET);
+        int choice;
+        scanf("%d", &choice);
+
+        if (choice == 1) {
+            dijkstra(graph, source, &cache);
+        } else if (choice == 2) {
+            bellmanFord(graph, source, &cache);
+        } else if (choice == 3) {
+            dijkstraHeap(graph, source, &cache);
+        } else if (choice == 4) {
+            bellmanFordQueue(graph, source, &cache);
+        } else if (choice == 5) {
+            deltaStepping(graph, source);
+        } else if (choice == 6) {
+            allPairsShortestPaths(graph);
+        } else if (choice == 7) {
+            pointToPointQuery(graph, source);
+        } else if (choice == 8) {
+            contractionHierarchyMenu(graph, source);
+        } else if (choice == 9) {
+            dynamicUpdatesMenu(graph, source);
+        } else if (choice == 10) {
+            pathToTarget(graph, source, &cache);
+        } else if (choice == 11) {
+            int newSource;
+            printf(BLUE "Enter new source node (0-%d): " RESET, graph->nodeCount - 1);
+            scanf("%d", &newSource);
+            if (!isValidNode(newSource, graph->nodeCount)) {
+                printf(RED "Invalid source node.\n" RESET);
+            } else {
+                source = newSource;
+            }
+        } else if (choice == 12) {
+            clearShortestPathCache(&cache);
+            return; // Go back to main menu
+        } else {
+            printf(RED "Invalid choice of algorithm.\n" RESET);
+        }
+    }
+}
+
+
+// Monotonic wall-clock time in seconds
+double nowSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+#ifdef Q1_COUNTERS
+void countersBegin(const char* algorithm, int source, int nodeCount, int edgeCount) {
+    memset(&runCounters, 0, sizeof(RunCounters));
+    runCounters.algorithm = algorithm;
+    runCounters.source = source;
+    runCounters.nodeCount = nodeCount;
+    runCounters.edgeCount = edgeCount;
+    runCounters.started = runCounters.phaseStarted = nowSeconds();
+}
+
+// Charge the time since the previous phase ended to phaseSeconds
+void countersPhase(double* phaseSeconds) {
+    double now = nowSeconds();
+    *phaseSeconds += now - runCounters.phaseStarted;
+    runCounters.phaseStarted = now;
+}
+
+// Append one JSON line to the file named by Q1_COUNTERS_FILE, or to stderr
+void countersEnd(const char* outcome) {
+    double total = nowSeconds() - runCounters.started;
+    const char* path = getenv("Q1_COUNTERS_FILE");
+    FILE* outputFile = path ? fopen(path, "a") : stderr;
+    if (!outputFile) return;
+
+    const RunCounters* c = &runCounters;
+    fprintf(outputFile,
+            "{\"algorithm\":\"%s\",\"source\":%d,\"nodes\":%d,\"edges\":%d,\"outcome\":\"%s\","
+            "\"relaxations\":%lld,\"improvements\":%lld,\"heap_pushes\":%lld,\"heap_decreases\":%lld,"
+            "\"heap_pops\":%lld,\"scans\":%lld,\"passes\":%lld,"
+            "\"setup_ms\":%.3f,\"scan_ms\":%.3f,\"main_ms\":%.3f,\"total_ms\":%.3f}\n",
+            c->algorithm, c->source, c->nodeCount, c->edgeCount, outcome, c->relaxations, c->improvements,
+            c->heapPushes, c->heapDecreases, c->heapPops, c->scans, c->passes, c->setupSeconds * 1e3,
+            c->scanSeconds * 1e3, c->mainSeconds * 1e3, total * 1e3);
+    if (path) fclose(outputFile);
+}
+#endif
+
+// Read fd to the end into a heap buffer, for pipes whose st_size means nothing
+static int readWholeFile(int fd, MappedFile* file) {
+    size_t capacity = 1 << 16;
+    char* data = (char*)malloc(capacity);
+    size_t size = 0;
+    while (data) {
+        if (size == capacity) {
+            char* grown = (char*)realloc(data, capacity * 2);
+            if (!grown) break;
+            data = grown;
+            capacity *= 2;
+        }
+        ssize_t got = read(fd, data + size, capacity - size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            if (got < 0) break;
+            file->data = data;
+            file->size = size;
+            file->copied = 1;
+            return 1;
+        }
+        size += (size_t)got;
+    }
+    free(data);
+    return 0;
+}
+
+// Map a whole file read-only, or read it into memory if it is not a regular
+// file. Returns 0 on failure.
+int mapFile(const char* path, MappedFile* file) {
+    file->data = NULL;
+    file->size = 0;
+    file->copied = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return 0;
+    }
+    if (!S_ISREG(info.st_mode)) {
+        int ok = readWholeFile(fd, file);
+        close(fd);
+        return ok;
+    }
+    file->size = (size_t)info.st_size;
+    if (file->size > 0) {
+        void* data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return 0;
+        }
+        madvise(data, file->size, MADV_SEQUENTIAL);
+        file->data = (const char*)data;
+    }
+    close(fd);
+    return 1;
+}
+
+void unmapFile(MappedFile* file) {
+    if (file->copied) {
+        free((void*)file->data);
+    } else if (file->data) {
+        munmap((void*)file->data, file->size);
+    }
+    file->data = NULL;
+    file->size = 0;
+}
+
+static int isIntegerSeparator(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '#';
+}
+
+// Parse every integer in a text buffer without going through the locale-aware
+// stdio/strtol machinery. Integers are separated by whitespace, and '#' starts
+// a comment running to the end of the line. A token that is not a plain
+// decimal int (such as "1.5", "x" or 2147483648) makes the whole parse fail:
+// NULL is returned and *errorLine is set to its 1-based line. If memory runs
+// out, NULL is returned with *errorLine set to 0.
+int* parseIntegers(const char* data, size_t size, int* count, int* errorLine) {
+    // Grown geometrically: sizing for the worst case of one digit and one
+    // separator per integer would reserve twice the file size up front
+    size_t capacity = 1024;
+    int* values = (int*)malloc(capacity * sizeof(int));
+    *errorLine = 0;
+    if (!values) return NULL;
+    const char* cursor = data;
+    const char* end = data + size;
+    int n = 0;
+    int line = 1;
+
+    while (cursor < end) {
+        char c = *cursor;
+        if (c == '#') {
+            while (cursor < end && *cursor != '\n') cursor++;
+            continue;
+        }
+        if (isIntegerSeparator(c)) {
+            if (c == '\n') line++;
+            cursor++;
+            continue;
+        }
+
+        int negative = c == '-';
+        if (negative) cursor++;
+        long long limit = negative ? (long long)INT_MAX + 1 : INT_MAX;
+        long long value = 0;
+        const char* digits = cursor;
+        int valid = 1;
+        while (valid && cursor < end && *cursor >= '0' && *cursor <= '9') {
+            value = value * 10 + (*cursor - '0');
+            valid = value <= limit;
+            cursor++;
+        }
+        if (!valid || cursor == digits || (cursor < end && !isIntegerSeparator(*cursor))) {
+            free(values);
+            *errorLine = line;
+            return NULL;
+        }
+        if ((size_t)n == capacity) {
+            int* grown = n < INT_MAX ? (int*)realloc(values, capacity * 2 * sizeof(int)) : NULL;
+            if (!grown) {
+                free(values);
+                return NULL;
+            }
+            values = grown;
+            capacity *= 2;
+        }
+        values[n++] = (int)(negative ? -value : value);
+    }
+
+    *count = n;
+    return values;
+}
+
+// Report why parseIntegers failed on the file at path
+static void printIntegerError(const char* path, int errorLine) {
+    if (errorLine > 0) {
+        fprintf(stderr, RED "Malformed or out-of-range integer on line %d: %s\n" RESET, errorLine, path);
+    } else {
+        fprintf(stderr, RED "Not enough memory to read: %s\n" RESET, path);
+    }
+}
+
+// Build a CSR graph straight from (u, v, w) triples with a counting sort, so no
+// per-edge allocation happens. Node count is one past the largest id seen.
+// Returns 1 on success, 0 if a node id is negative or INT_MAX (the node count
+// would overflow) and -1 if memory runs out.
+int buildCSRFromTriples(const int* triples, int edgeCount, CSRGraph* csr) {
+    int maxNode = -1;
+    for (int e = 0; e < edgeCount; e++) {
+        int u = triples[3 * e];
+        int v = triples[3 * e + 1];
+        if (u < 0 || v < 0 || u == INT_MAX || v == INT_MAX) return 0;
+        if (u > maxNode) maxNode = u;
+        if (v > maxNode) maxNode = v;
+    }
+
+    int n = maxNode + 1;
+    csr->nodeCount = n;
+    csr->edgeCount = edgeCount;
+    csr->offsets = (int*)calloc((size_t)n + 1, sizeof(int));
+    csr->targets = (int*)malloc((edgeCount > 0 ? edgeCount : 1) * sizeof(int));
+    csr->weights = (int*)malloc((edgeCount > 0 ? edgeCount : 1) * sizeof(int));
+    int* cursor = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    if (!csr->offsets || !csr->targets || !csr->weights || !cursor) {
+        freeCSR(csr);
+        free(cursor);
+        return -1;
+    }
+
+    for (int e = 0; e < edgeCount; e++) {
+        csr->offsets[triples[3 * e] + 1]++;
+    }
+    for (int u = 0; u < n; u++) {
+        csr->offsets[u + 1] += csr->offsets[u];
+    }
+
+    // Scatter using a moving cursor per node, keeping each node's edges in file order
+    memcpy(cursor, csr->offsets, n * sizeof(int));
+    for (int e = 0; e < edgeCount; e++) {
+        int slot = cursor[triples[3 * e]]++;
+        csr->targets[slot] = triples[3 * e + 1];
+        csr->weights[slot] = triples[3 * e + 2];
+    }
+    free(cursor);
+    return 1;
+}
+
+// Load an edge list of "u v w" lines (or raw native-endian int32 triples when
+// binary is set) into a CSR graph. Returns 0 and prints the reason on failure.
+int loadEdgeList(const char* path, int binary, CSRGraph* csr) {
+    MappedFile file;
+    if (!mapFile(path, &file)) {
+        fprintf(stderr, RED "Error opening edge list: %s\n" RESET, path);
+        return 0;
+    }
+
+    int ok;
+    if (binary) {
+        if (file.size % (3 * sizeof(int)) != 0 || file.size / (3 * sizeof(int)) > INT_MAX) {
+            fprintf(stderr, RED "Binary edge list size is not a multiple of 12 bytes or too large: %s\n" RESET, path);
+            unmapFile(&file);
+            return 0;
+        }
+        ok = buildCSRFromTriples((const int*)file.data, (int)(file.size / (3 * sizeof(int))), csr);
+    } else {
+        int count, errorLine;
+        int* values = parseIntegers(file.data, file.size, &count, &errorLine);
+        if (!values) {
+            printIntegerError(path, errorLine);
+            unmapFile(&file);
+            return 0;
+        }
+        if (count % 3 != 0) {
+            fprintf(stderr, RED "Edge list must contain 'u v w' triples: %s\n" RESET, path);
+            free(values);
+            unmapFile(&file);
+            return 0;
+        }
+        ok = buildCSRFromTriples(values, count / 3, csr);
+        free(values);
+    }
+    unmapFile(&file);
+
+    if (ok == 0) {
+        fprintf(stderr, RED "Edge list contains a node id outside 0..%d: %s\n" RESET, INT_MAX - 1, path);
+    } else if (ok < 0) {
+        fprintf(stderr, RED "Not enough memory for the edge list: %s\n" RESET, path);
+    }
+    return ok > 0;
+}
+
+// Arrays start at 8-byte boundaries so the coordinate doubles are aligned
+static size_t graphImageAlign(size_t offset) {
+    return (offset + 7) & ~(size_t)7;
+}
+
+// Header is 24 bytes, so offsets start aligned
+static size_t graphImageCoordinatesOffset(int nodeCount, int edgeCount) {
+    size_t offset = 24 + ((size_t)nodeCount + 1) * sizeof(int);
+    offset += 2 * (size_t)edgeCount * sizeof(int);
+    return graphImageAlign(offset);
+}
+
+// File layout, native-endian: "CSRG", uint32 version, uint32 node count,
+// uint32 edge count, uint32 flags, uint32 reserved, int32 offsets[n + 1],
+// targets[m], weights[m], then, padded to 8 bytes and only when flagged,
+// double x[n] and y[n]. coordinates may be NULL. Returns 0 on an I/O error.
+int saveGraphImage(const CSRGraph* csr, const Coordinates* coordinates, const char* path) {
+    FILE* outputFile = fopen(path, "wb");
+    if (!outputFile) return 0;
+
+    uint32_t header[5] = {GRAPH_IMAGE_VERSION, (uint32_t)csr->nodeCount, (uint32_t)csr->edgeCount,
+                          coordinates ? GRAPH_IMAGE_HAS_COORDINATES : 0u, 0u};
+    int ok = fwrite(GRAPH_IMAGE_MAGIC, 1, 4, outputFile) == 4 && fwrite(header, sizeof(uint32_t), 5, outputFile) == 5;
+    ok = ok && writeInts(outputFile, csr->offsets, csr->nodeCount + 1);
+    ok = ok && writeInts(outputFile, csr->targets, csr->edgeCount);
+    ok = ok && writeInts(outputFile, csr->weights, csr->edgeCount);
+    if (ok && coordinates) {
+        size_t written = 24 + ((size_t)csr->nodeCount + 1 + 2 * (size_t)csr->edgeCount) * sizeof(int);
+        static const char padding[8] = {0};
+        size_t pad = graphImageCoordinatesOffset(csr->nodeCount, csr->edgeCount) - written;
+        ok = fwrite(padding, 1, pad, outputFile) == pad;
+        ok = ok && fwrite(coordinates->x, sizeof(double), csr->nodeCount, outputFile) == (size_t)csr->nodeCount;
+        ok = ok && fwrite(coordinates->y, sizeof(double), csr->nodeCount, outputFile) == (size_t)csr->nodeCount;
+    }
+    if (fclose(outputFile) != 0) ok = 0;
+    return ok;
+}
+
+// Map a graph image written by saveGraphImage. Nothing is copied or parsed:
+// pages are faulted in as searches touch them and are shared through the page
+// cache with every other process mapping the same file. Besides the header and
+// total size, one pass checks the offsets and targets so a damaged image
+// cannot send a search out of bounds. Returns 0 on failure.
+int openGraphImage(const char* path, MappedGraph* graph) {
+    memset(graph, 0, sizeof(MappedGraph));
+    if (!mapFile(path, &graph->file)) return 0;
+
+    const char* data = graph->file.data;
+    uint32_t header[5];
+    if (graph->file.size < 24 || memcmp(data, GRAPH_IMAGE_MAGIC, 4) != 0) {
+        unmapFile(&graph->file);
+        return 0;
+    }
+    memcpy(header, data + 4, sizeof(header));
+    if (header[0] != GRAPH_IMAGE_VERSION || header[1] > INT_MAX - 1 || header[2] > INT_MAX) {
+        unmapFile(&graph->file);
+        return 0;
+    }
+
+    int n = (int)header[1];
+    int m = (int)header[2];
+    int hasCoordinates = (header[3] & GRAPH_IMAGE_HAS_COORDINATES) != 0;
+    size_t coordinatesOffset = graphImageCoordinatesOffset(n, m);
+    size_t expected = hasCoordinates ? coordinatesOffset + 2 * (size_t)n * sizeof(double)
+                                     : 24 + ((size_t)n + 1 + 2 * (size_t)m) * sizeof(int);
+    const int* offsets = (const int*)(data + 24);
+    if (graph->file.size != expected || !validCSRArrays(offsets, offsets + n + 1, n, m)) {
+        unmapFile(&graph->file);
+        return 0;
+    }
+    // mapFile asks for sequential readahead; searches jump around
+    if (!graph->file.copied) madvise((void*)data, graph->file.size, MADV_NORMAL);
+
+    graph->csr.nodeCount = n;
+    graph->csr.edgeCount = m;
+    graph->csr.offsets = (int*)offsets;
+    graph->csr.targets = (int*)offsets + n + 1;
+    graph->csr.weights = graph->csr.targets + m;
+    graph->hasCoordinates = hasCoordinates;
+    if (hasCoordinates) {
+        graph->coordinates.nodeCount = n;
+        graph->coordinates.x = (double*)(data + coordinatesOffset);
+        graph->coordinates.y = graph->coordinates.x + n;
+        graph->coordinates.scale = 1.0;
+    }
+    return 1;
+}
+
+void closeGraphImage(MappedGraph* graph) {
+    unmapFile(&graph->file);
+    memset(graph, 0, sizeof(MappedGraph));
+}
+
+// Offline conversion to a graph image:
+//   q1 --convert [--binary] <edge-list> <image> [--coords <file>]
+int runConvertMode(int argc, char** argv) {
+    int binary = argc > 2 && strcmp(argv[2], "--binary") == 0;
+    const char* coordinatesPath = NULL;
+    if (argc == 6 + binary && strcmp(argv[4 + binary], "--coords") == 0) {
+        coordinatesPath = argv[5 + binary];
+    } else if (argc != 4 + binary) {
+        fprintf(stderr, "Usage: %s --convert [--binary] <edge-list> <image> [--coords <file>]\n", argv[0]);
+        return 1;
+    }
+
+    CSRGraph csr;
+    if (!loadEdgeList(argv[2 + binary], binary, &csr)) return 1;
+
+    Coordinates coordinates;
+    int errorLine;
+    if (coordinatesPath && !loadCoordinates(coordinatesPath, csr.nodeCount, &coordinates, &errorLine)) {
+        printCoordinatesError(stderr, coordinatesPath, errorLine);
+        freeCSR(&csr);
+        return 1;
+    }
+
+    int status = 0;
+    if (!saveGraphImage(&csr, coordinatesPath ? &coordinates : NULL, argv[3 + binary])) {
+        fprintf(stderr, RED "Error writing graph image: %s\n" RESET, argv[3 + binary]);
+        status = 1;
+    } else {
+        fprintf(stderr, "Wrote %d nodes and %d edges%s to %s\n", csr.nodeCount, csr.edgeCount,
+                coordinatesPath ? " with coordinates" : "", argv[3 + binary]);
+    }
+    if (coordinatesPath) freeCoordinates(&coordinates);
+    freeCSR(&csr);
+    return status;
+}
+
+static void bufferReserve(CharBuffer* buffer, size_t extra) {
+    if (buffer->size + extra <= buffer->capacity) return;
+    while (buffer->size + extra > buffer->capacity) {
+        buffer->capacity = buffer->capacity > 0 ? buffer->capacity * 2 : BATCH_OUTPUT_INITIAL;
+    }
+    buffer->data = (char*)realloc(buffer->data, buffer->capacity);
+}
+
+static void bufferAppendInt(CharBuffer* buffer, long long value) {
+    char digits[24];
+    int length = 0;
+    unsigned long long magnitude = value < 0 ? -(unsigned long long)value : (unsigned long long)value;
+    do {
+        digits[length++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    bufferReserve(buffer, length + 1);
+    if (value < 0) buffer->data[buffer->size++] = '-';
+    while (length > 0) {
+        buffer->data[buffer->size++] = digits[--length];
+    }
+}
+
+static void bufferAppendString(CharBuffer* buffer, const char* text) {
+    size_t length = strlen(text);
+    bufferReserve(buffer, length);
+    memcpy(buffer->data + buffer->size, text, length);
+    buffer->size += length;
+}
+
+// Sort key for grouping queries by source
+typedef struct BatchQuery {
+    int source;
+    int target;
+    int index;
+} BatchQuery;
+
+static int compareQueriesBySource(const void* a, const void* b) {
+    const BatchQuery* x = (const BatchQuery*)a;
+    const BatchQuery* y = (const BatchQuery*)b;
+    if (x->source != y->source) return x->source < y->source ? -1 : 1;
+    return x->index - y->index;
+}
+
+// Read "source target" pairs from a query file into a flat array. Returns NULL
+// and prints the reason on failure.
+int* loadQueryPairs(const char* path, int* queryCount) {
+    MappedFile queryFile;
+    if (!mapFile(path, &queryFile)) {
+        fprintf(stderr, RED "Error opening query file: %s\n" RESET, path);
+        return NULL;
+    }
+    int valueCount, errorLine;
+    int* values = parseIntegers(queryFile.data, queryFile.size, &valueCount, &errorLine);
+    unmapFile(&queryFile);
+    if (!values) {
+        printIntegerError(path, errorLine);
+        return NULL;
+    }
+    if (valueCount % 2 != 0) {
+        fprintf(stderr, RED "Query file must contain 'source target' pairs: %s\n" RESET, path);
+        free(values);
+        return NULL;
+    }
+    *queryCount = valueCount / 2;
+    return values;
+}
+
+// Emit every answer in query order with a single write
+void writeBatchAnswers(const int* pairs, int queryCount, const int* answers, const char* answerValid) {
+    CharBuffer output = {0};
+    bufferReserve(&output, BATCH_OUTPUT_INITIAL);
+    for (int q = 0; q < queryCount; q++) {
+        bufferAppendInt(&output, pairs[2 * q]);
+        bufferAppendString(&output, " ");
+        bufferAppendInt(&output, pairs[2 * q + 1]);
+        bufferAppendString(&output, " ");
+        if (!answerValid[q]) {
+            bufferAppendString(&output, "invalid");
+        } else if (answers[q] == INT_MAX) {
+            bufferAppendString(&output, "unreachable");
+        } else {
+            bufferAppendInt(&output, answers[q]);
+        }
+        bufferAppendString(&output, "\n");
+    }
+    fwrite(output.data, 1, output.size, stdout);
+    fflush(stdout);
+    free(output.data);
+}
+
+// Free the batch graph unless it still points into the mapped image, then unmap
+static void releaseBatchGraph(CSRGraph* csr, MappedGraph* image) {
+    if (csr->offsets != image->csr.offsets) freeCSR(csr);
+    closeGraphImage(image);
+}
+
+// Non-interactive mode:
+//   q1 --batch [--binary | --mapped] [--p2p] [--multi] [--coords <file> <scale>] <edge-list> <queries>
+// Queries are "source target" pairs; each answer is printed as
+// "source target distance" in query order, with "unreachable" or "invalid"
+// in place of the distance where appropriate. By default one full search runs
+// per distinct source; --p2p answers each query with a bidirectional search,
+// or with A* when coordinates are given. With --mapped the graph is an image
+// from --convert, searched in place without being parsed or copied.
+int runBatchMode(int argc, char** argv) {
+    const char* usage = "Usage: %s --batch [--binary | --mapped] [--p2p] [--multi] [--coords <file> <scale>]"
+                        " [--reorder none|bfs|rcm|degree] <edge-list> <queries>\n";
+    int binary = 0;
+    int mapped = 0;
+    int multiSource = 0;
+    VertexOrdering ordering = ORDER_NONE;
+    int pointToPoint = 0;
+    const char* coordinatesPath = NULL;
+    double coordinatesScale = 1.0;
+    const char* paths[2];
+    int pathCount = 0;
+
+    if (strcmp(argv[1], "--batch") != 0) {
+        fprintf(stderr, usage, argv[0]);
+        return 1;
+    }
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--binary") == 0) {
+            binary = 1;
+        } else if (strcmp(argv[i], "--mapped") == 0) {
+            mapped = 1;
+        } else if (strcmp(argv[i], "--p2p") == 0) {
+            pointToPoint = 1;
+        } else if (strcmp(argv[i], "--multi") == 0) {
+            multiSource = 1;
+        } else if (strcmp(argv[i], "--coords") == 0 && i + 2 < argc) {
+            pointToPoint = 1;
+            coordinatesPath = argv[++i];
+            coordinatesScale = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--reorder") == 0) {
+            if (i + 1 == argc || !parseVertexOrdering(argv[i + 1], &ordering)) {
+                if (i + 1 < argc) fprintf(stderr, RED "Unknown vertex ordering: %s\n" RESET, argv[i + 1]);
+                fprintf(stderr, usage, argv[0]);
+                return 1;
+            }
+            i++;
+        } else if (pathCount < 2) {
+            paths[pathCount++] = argv[i];
+        } else {
+            pathCount = 3;
+        }
+    }
+    if (pathCount != 2) {
+        fprintf(stderr, usage, argv[0]);
+        return 1;
+    }
+
+    double start = nowSeconds();
+    CSRGraph csr;
+    MappedGraph image = {{0}, {0}, {0}, 0};
+    if (mapped) {
+        if (!openGraphImage(paths[0], &image)) {
+            fprintf(stderr, RED "Error opening graph image: %s\n" RESET, paths[0]);
+            return 1;
+        }
+        csr = image.csr;
+    } else if (!loadEdgeList(paths[0], binary, &csr)) {
+        return 1;
+    }
+
+    // Answers are distances, so only the query endpoints need translating
+    ReorderedGraph reordered = {{0}, NULL, NULL};
+    if (ordering != ORDER_NONE) {
+        reorderCSR(&csr, ordering, &reordered);
+        if (!mapped) freeCSR(&csr);
+        csr = reordered.csr;
+    }
+    double loaded = nowSeconds();
+
+    int queryCount;
+    int* values = loadQueryPairs(paths[1], &queryCount);
+    if (!values) {
+        releaseBatchGraph(&csr, &image);
+        free(reordered.newId);
+        free(reordered.oldId);
+        return 1;
+    }
+
+    BatchQuery* queries = (BatchQuery*)malloc((queryCount > 0 ? queryCount : 1) * sizeof(BatchQuery));
+    for (int q = 0; q < queryCount; q++) {
+        queries[q].source = values[2 * q];
+        queries[q].target = values[2 * q + 1];
+        queries[q].index = q;
+        if (reordered.newId != NULL && isValidNode(queries[q].source, csr.nodeCount) &&
+            isValidNode(queries[q].target, csr.nodeCount)) {
+            queries[q].source = reordered.newId[queries[q].source];
+            queries[q].target = reordered.newId[queries[q].target];
+        }
+    }
+    qsort(queries, queryCount, sizeof(BatchQuery), compareQueriesBySource);
+
+    int hasNegative = 0;
+    for (int k = 0; k < csr.edgeCount; k++) {
+        if (csr.weights[k] < 0) {
+            hasNegative = 1;
+            break;
+        }
+    }
+
+    if (pointToPoint && hasNegative) {
+        fprintf(stderr, RED "Point-to-point queries need non-negative weights.\n" RESET);
+        free(values);
+        free(queries);
+        releaseBatchGraph(&csr, &image);
+        free(reordered.newId);
+        free(reordered.oldId);
+        return 1;
+    }
+
+    int n = csr.nodeCount;
+    int* distances = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    int* prev = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    int* cycle = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    MonotoneQueue* queue = createMonotoneQueue(n, hasNegative ? 0 : maxEdgeWeight(&csr), QUEUE_AUTO);
+    int* answers = (int*)malloc((queryCount > 0 ? queryCount : 1) * sizeof(int));
+    char* answerValid = (char*)calloc(queryCount > 0 ? queryCount : 1, sizeof(char));
+    int currentSource = -1;
+    int runs = 0;
+    int status = 0;
+
+    if (pointToPoint) {
+        CSRGraph reverse;
+        Coordinates coordinates;
+        int errorLine;
+        buildReverseCSR(&csr, &reverse);
+        if (coordinatesPath && image.hasCoordinates && strcmp(coordinatesPath, paths[0]) == 0) {
+            // Coordinates stored in the image itself; copied because reordering permutes them
+            coordinates.nodeCount = n;
+            coordinates.x = (double*)malloc((n > 0 ? n : 1) * sizeof(double));
+            coordinates.y = (double*)malloc((n > 0 ? n : 1) * sizeof(double));
+            memcpy(coordinates.x, image.coordinates.x, n * sizeof(double));
+            memcpy(coordinates.y, image.coordinates.y, n * sizeof(double));
+        } else if (coordinatesPath && !loadCoordinates(coordinatesPath, n, &coordinates, &errorLine)) {
+            printCoordinatesError(stderr, coordinatesPath, errorLine);
+            coordinatesPath = NULL;
+            status = 1;
+        }
+        if (coordinatesPath) coordinates.scale = coordinatesScale;
+        if (coordinatesPath && reordered.newId != NULL) {
+            double* x = (double*)malloc(n * sizeof(double));
+            double* y = (double*)malloc(n * sizeof(double));
+            for (int v = 0; v < n; v++) {
+                x[reordered.newId[v]] = coordinates.x[v];
+                y[reordered.newId[v]] = coordinates.y[v];
+            }
+            free(coordinates.x);
+            free(coordinates.y);
+            coordinates.x = x;
+            coordinates.y = y;
+        }
+
+        SearchSpace* forward = createSearchSpace(n);
+        SearchSpace* backward = createSearchSpace(n);
+        for (int q = 0; q < queryCount && status == 0; q++) {
+            BatchQuery* query = &queries[q];
+            if (!isValidNode(query->source, n) || !isValidNode(query->target, n)) continue;
+
+            int settled, meeting;
+            COUNTERS_BEGIN(coordinatesPath ? "astar" : "bidirectional", query->source, n, csr.edgeCount);
+            if (coordinatesPath) {
+                answers[query->index] = astarToTarget(&csr, query->source, query->target, euclideanHeuristic,
+                                                      &coordinates, forward, &settled);
+            } else {
+                answers[query->index] = bidirectionalDijkstra(&csr, &reverse, query->source, query->target,
+                                                              forward, backward, &meeting, &settled);
+            }
+            COUNTERS_PHASE(mainSeconds);
+            COUNTERS_END("ok");
+            answerValid[query->index] = 1;
+            runs++;
+        }
+        freeSearchSpace(forward);
+        freeSearchSpace(backward);
+        freeCSR(&reverse);
+        if (coordinatesPath) freeCoordinates(&coordinates);
+    }
+
+    // Several distinct sources per traversal when asked and weights allow it
+    if (multiSource && !pointToPoint && !hasNegative && status == 0) {
+        const char* kernelName;
+        LaneKernel kernel = selectLaneKernel(1, &kernelName);
+        int* chunkSources = (int*)malloc(MULTI_SOURCE_LANES * sizeof(int));
+        int* matrix = (int*)malloc((size_t)MULTI_SOURCE_LANES * (n > 0 ? n : 1) * sizeof(int));
+        int q = 0;
+        while (q < queryCount) {
+            // Queries are sorted by source: take the next run of distinct sources
+            int lanes = 0, end = q;
+            while (end < queryCount) {
+                BatchQuery* query = &queries[end];
+                if (isValidNode(query->source, n) && isValidNode(query->target, n) &&
+                    (lanes == 0 || chunkSources[lanes - 1] != query->source)) {
+                    if (lanes == MULTI_SOURCE_LANES) break;
+                    chunkSources[lanes++] = query->source;
+                }
+                end++;
+            }
+            if (lanes > 0) {
+                multiSourceDistances(&csr, chunkSources, lanes, matrix, kernel);
+                runs++;
+            }
+
+            int lane = -1;
+            for (; q < end; q++) {
+                BatchQuery* query = &queries[q];
+                if (!isValidNode(query->source, n) || !isValidNode(query->target, n)) continue;
+                if (lane < 0 || chunkSources[lane] != query->source) lane++;
+                answers[query->index] = matrix[(size_t)lane * n + query->target];
+                answerValid[query->index] = 1;
+            }
+        }
+        free(chunkSources);
+        free(matrix);
+    }
+
+    // Otherwise one shortest-path run per distinct source
+    for (int q = 0; q < queryCount && status == 0 && !pointToPoint && !(multiSource && !hasNegative); q++) {
+        BatchQuery* query = &queries[q];
+        if (!isValidNode(query->source, n) || !isValidNode(query->target, n)) continue;
+
+        if (query->source != currentSource) {
+            currentSource = query->source;
+            runs++;
+            COUNTERS_BEGIN(hasNegative ? "spfa" : "dijkstra", currentSource, n, csr.edgeCount);
+            if (!hasNegative) {
+                dijkstraMonotoneDistances(&csr, currentSource, distances, prev, queue);
+            } else if (spfaDistances(&csr, currentSource, distances, prev, cycle) > 0) {
+                fprintf(stderr, RED "Graph contains a negative weight cycle reachable from node %d.\n" RESET, currentSource);
+                status = 1;
+            }
+            COUNTERS_PHASE(mainSeconds);
+            COUNTERS_END(status == 0 ? "ok" : "negative_cycle");
+        }
+        answers[query->index] = distances[query->target];
+        answerValid[query->index] = 1;
+    }
+    double answered = nowSeconds();
+
+    if (status == 0) {
+        writeBatchAnswers(values, queryCount, answers, answerValid);
+        fprintf(stderr, "Loaded %d nodes and %d edges in %.3f s; answered %d queries with %d shortest-path run(s) in %.3f s.\n",
+                csr.nodeCount, csr.edgeCount, loaded - start, queryCount, runs, answered - loaded);
+    }
+
+    free(values);
+    free(answerValid);
+    free(answers);
+    free(queries);
+    free(distances);
+    free(prev);
+    free(cycle);
+    freeMonotoneQueue(queue);
+    releaseBatchGraph(&csr, &image);
+    free(reordered.newId);
+    free(reordered.oldId);
+    return status;
+}
+
+// Offline preprocessing:
+//   q1 --build-ch [--binary] <edge-list> <hierarchy>
+int runBuildHierarchyMode(int argc, char** argv) {
+    int binary = argc == 5 && strcmp(argv[2], "--binary") == 0;
+    if (argc != 4 + binary) {
+        fprintf(stderr, "Usage: %s --build-ch [--binary] <edge-list> <hierarchy>\n", argv[0]);
+        return 1;
+    }
+
+    CSRGraph csr;
+    if (!loadEdgeList(argv[2 + binary], binary, &csr)) return 1;
+    for (int k = 0; k < csr.edgeCount; k++) {
+        if (csr.weights[k] < 0) {
+            fprintf(stderr, RED "Contraction hierarchies need non-negative weights.\n" RESET);
+            freeCSR(&csr);
+            return 1;
+        }
+    }
+
+    double start = nowSeconds();
+    ContractionHierarchy ch;
+    buildContractionHierarchy(&csr, &ch);
+    double built = nowSeconds();
+
+    int status = 0;
+    if (!saveContractionHierarchy(&ch, argv[3 + binary])) {
+        fprintf(stderr, RED "Error writing hierarchy: %s\n" RESET, argv[3 + binary]);
+        status = 1;
+    } else {
+        fprintf(stderr, "Contracted %d nodes in %.3f s: %d upward + %d downward arcs for %d original edges.\n",
+                ch.nodeCount, built - start, ch.upward.edgeCount, ch.downward.edgeCount, csr.edgeCount);
+    }
+    freeContractionHierarchy(&ch);
+    freeCSR(&csr);
+    return status;
+}
+
+// Query serving against a prebuilt hierarchy:
+//   q1 --ch-query <hierarchy> <queries>
+// Output matches --batch mode.
+int runHierarchyQueryMode(int argc, char** argv) {
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s --ch-query <hierarchy> <queries>\n", argv[0]);
+        return 1;
+    }
+
+    double start = nowSeconds();
+    ContractionHierarchy ch;
+    if (!loadContractionHierarchy(argv[2], &ch)) {
+        fprintf(stderr, RED "Error reading hierarchy: %s\n" RESET, argv[2]);
+        return 1;
+    }
+    int queryCount;
+    int* pairs = loadQueryPairs(argv[3], &queryCount);
+    if (!pairs) {
+        freeContractionHierarchy(&ch);
+        return 1;
+    }
+    double loaded = nowSeconds();
+
+    int n = ch.nodeCount;
+    SearchSpace* forward = createSearchSpace(n);
+    SearchSpace* backward = createSearchSpace(n);
+    int* answers = (int*)malloc((queryCount > 0 ? queryCount : 1) * sizeof(int));
+    char* answerValid = (char*)calloc(queryCount > 0 ? queryCount : 1, sizeof(char));
+    for (int q = 0; q < queryCount; q++) {
+        int meeting;
+        if (!isValidNode(pairs[2 * q], n) || !isValidNode(pairs[2 * q + 1], n)) continue;
+        answers[q] = hierarchyQuery(&ch, pairs[2 * q], pairs[2 * q + 1], forward, backward, &meeting);
+        answerValid[q] = 1;
+    }
+    double answered = nowSeconds();
+
+    writeBatchAnswers(pairs, queryCount, answers, answerValid);
+    fprintf(stderr, "Loaded hierarchy for %d nodes in %.3f s; answered %d queries in %.3f s.\n",
+            n, loaded - start, queryCount, answered - loaded);
+
+    free(answers);
+    free(answerValid);
+    free(pairs);
+    freeSearchSpace(forward);
+    freeSearchSpace(backward);
+    freeContractionHierarchy(&ch);
+    return 0;
+}
+
+// splitmix64: small, fast and identical on every platform, so a seed always
+// produces the same graph
+uint64_t nextRandom(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static int randomBelow(uint64_t* state, int bound) {
+    return (int)(nextRandom(state) % (uint64_t)bound);
+}
+
+static int randomWeight(uint64_t* state) {
+    return 1 + randomBelow(state, BENCH_MAX_WEIGHT);
+}
+
+// Uniform random digraph with edgesPerNode * nodes edges
+void generateRandomGraph(Graph* graph, int nodes, int edgesPerNode, uint64_t seed) {
+    initGraph(graph, nodes);
+    long long edges = (long long)nodes * edgesPerNode;
+    for (long long e = 0; e < edges; e++) {
+        int u = randomBelow(&seed, nodes);
+        int v = randomBelow(&seed, nodes);
+        addEdge(graph, u, v, randomWeight(&seed));
+    }
+}
+
+// Square 4-neighbour grid with both directions of every edge
+void generateGridGraph(Graph* graph, int nodes, uint64_t seed) {
+    int side = (int)sqrt((double)nodes);
+    if (side < 1) side = 1;
+    initGraph(graph, side * side);
+    for (int r = 0; r < side; r++) {
+        for (int c = 0; c < side; c++) {
+            int v = r * side + c;
+            if (c + 1 < side) {
+                int weight = randomWeight(&seed);
+                addEdge(graph, v, v + 1, weight);
+                addEdge(graph, v + 1, v, weight);
+            }
+            if (r + 1 < side) {
+                int weight = randomWeight(&seed);
+                addEdge(graph, v, v + side, weight);
+                addEdge(graph, v + side, v, weight);
+            }
+        }
+    }
+}
+
+// R-MAT power-law digraph (a, b, c, d = 0.57, 0.19, 0.19, 0.05) over the next
+// power of two; endpoints beyond nodes are folded back into range
+void generateRmatGraph(Graph* graph, int nodes, int edgesPerNode, uint64_t seed) {
+    int scale = 0;
+    while ((1 << scale) < nodes) scale++;
+    initGraph(graph, nodes);
+    long long edges = (long long)nodes * edgesPerNode;
+    for (long long e = 0; e < edges; e++) {
+        int u = 0, v = 0;
+        for (int bit = 0; bit < scale; bit++) {
+            int r = randomBelow(&seed, 100);
+            if (r >= 57 && r < 76) {
+                v |= 1 << bit;
+            } else if (r >= 76 && r < 95) {
+                u |= 1 << bit;
+            } else if (r >= 95) {
+                u |= 1 << bit;
+                v |= 1 << bit;
+            }
+        }
+        addEdge(graph, u % nodes, v % nodes, randomWeight(&seed));
+    }
+}
+
+// Road-like network: jittered grid points joined to nearby neighbours with
+// some links missing and a few diagonals, weighted by Euclidean length
+void generateRoadGraph(Graph* graph, int nodes, uint64_t seed) {
+    int side = (int)sqrt((double)nodes);
+    if (side < 1) side = 1;
+    int n = side * side;
+    double* x = (double*)malloc(n * sizeof(double));
+    double* y = (double*)malloc(n * sizeof(double));
+    for (int v = 0; v < n; v++) {
+        x[v] = v % side + (randomBelow(&seed, 1000) - 500) / 1500.0;
+        y[v] = v / side + (randomBelow(&seed, 1000) - 500) / 1500.0;
+    }
+
+    initGraph(graph, n);
+    for (int v = 0; v < n; v++) {
+        int r = v / side, c = v % side;
+        int neighbours[3] = {-1, -1, -1};
+        if (c + 1 < side && randomBelow(&seed, 10) < 9) neighbours[0] = v + 1;
+        if (r + 1 < side && randomBelow(&seed, 10) < 9) neighbours[1] = v + side;
+        if (r + 1 < side && c + 1 < side && randomBelow(&seed, 10) == 0) neighbours[2] = v + side + 1;
+        for (int k = 0; k < 3; k++) {
+            int u = neighbours[k];
+            if (u < 0) continue;
+            double dx = x[u] - x[v], dy = y[u] - y[v];
+            int weight = 1 + (int)(BENCH_MAX_WEIGHT * sqrt(dx * dx + dy * dy));
+            addEdge(graph, v, u, weight);
+            addEdge(graph, u, v, weight);
+        }
+    }
+    free(x);
+    free(y);
+}
+
+// Build the named graph kind. Returns 0 for an unknown kind.
+int generateGraph(Graph* graph, const char* kind, int nodes, uint64_t seed) {
+    if (strcmp(kind, "random") == 0) {
+        generateRandomGraph(graph, nodes, BENCH_EDGES_PER_NODE, seed);
+    } else if (strcmp(kind, "grid") == 0) {
+        generateGridGraph(graph, nodes, seed);
+    } else if (strcmp(kind, "rmat") == 0) {
+        generateRmatGraph(graph, nodes, BENCH_EDGES_PER_NODE, seed);
+    } else if (strcmp(kind, "road") == 0) {
+        generateRoadGraph(graph, nodes, seed);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Write a generated graph as a text edge list that --batch can read
+int runGenerateMode(int argc, char** argv) {
+    if (argc != 5 || atoi(argv[3]) <= 0) {
+        fprintf(stderr, "Usage: %s --generate <random|grid|rmat|road> <nodes> <seed>\n", argv[0]);
+        return 1;
+    }
+    Graph graph = {0};
+    if (!generateGraph(&graph, argv[2], atoi(argv[3]), strtoull(argv[4], NULL, 10))) {
+        fprintf(stderr, RED "Unknown graph kind: %s\n" RESET, argv[2]);
+        return 1;
+    }
+
+    CharBuffer out = {0};
+    for (int u = 0; u < graph.nodeCount; u++) {
+        for (Edge* edge = graph.adjacencyList[u]; edge != NULL; edge = edge->next) {
+            bufferReserve(&out, 48);
+            bufferAppendInt(&out, u);
+            bufferAppendString(&out, " ");
+            bufferAppendInt(&out, edge->destination);
+            bufferAppendString(&out, " ");
+            bufferAppendInt(&out, edge->weight);
+            bufferAppendString(&out, "\n");
+        }
+    }
+    fwrite(out.data, 1, out.size, stdout);
+    free(out.data);
+    freeGraph(&graph);
+    return 0;
+}
+
+// Reset the kernel's peak resident set size (VmHWM) to the current one, so
+// peakResidentKilobytes covers only what runs afterwards. Linux only;
+// returns 0 where the reset is unavailable.
+static int resetPeakResident() {
+#ifdef __linux__
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd < 0) return 0;
+    int ok = write(fd, "5", 1) == 1;
+    close(fd);
+    return ok;
+#else
+    return 0;
+#endif
+}
+
+// Peak resident set size in KiB: VmHWM since the last resetPeakResident on
+// Linux, else the lifetime ru_maxrss, which never falls
+static long peakResidentKilobytes() {
+#ifdef __linux__
+    FILE* status = fopen("/proc/self/status", "r");
+    if (status) {
+        char line[256];
+        long kilobytes = -1;
+        while (kilobytes < 0 && fgets(line, sizeof(line), status)) {
+            if (sscanf(line, "VmHWM: %ld", &kilobytes) != 1) kilobytes = -1;
+        }
+        fclose(status);
+        if (kilobytes >= 0) return kilobytes;
+    }
+#endif
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+typedef enum BenchAlgorithm {
+    BENCH_DIJKSTRA,
+    BENCH_BELLMAN_FORD,
+    BENCH_DIJKSTRA_HEAP,
+    BENCH_QUEUE_BELLMAN_FORD,
+    BENCH_DELTA_STEPPING,
+    BENCH_EDGE_ARRAY_BELLMAN_FORD,
+    BENCH_MULTI_SOURCE,
+    BENCH_DIAL,
+    BENCH_RADIX_HEAP,
+    BENCH_ALGORITHM_COUNT
+} BenchAlgorithm;
+
+static const char* benchAlgorithmNames[BENCH_ALGORITHM_COUNT] = {
+    "Dijkstra (array)", "Bellman-Ford", "Dijkstra (heap)", "Bellman-Ford (queue)", "Delta-stepping",
+    "Bellman-Ford (SoA)", "Multi-source Dijkstra", "Dijkstra (Dial)", "Dijkstra (radix heap)"
+};
+
+// Run every shortest-path algorithm over generated graphs and compare each
+// result with the binary-heap Dijkstra. Exits non-zero on any mismatch.
+int runBenchmarkMode(int argc, char** argv) {
+    const char* usage = "Usage: %s --bench [--nodes N] [--seed S] [--sources K] [--graphs random,grid,rmat,road]"
+                        " [--shuffle] [--reorder none|bfs|rcm|degree] [--no-simd]\n";
+    int nodes = BENCH_DEFAULT_NODES;
+    int sourceCount = 3;
+    uint64_t seed = 1;
+    char kinds[256] = "random,grid,rmat,road";
+    VertexOrdering ordering = ORDER_NONE;
+    int shuffle = 0;
+    int allowSimd = 1;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--nodes") == 0 && i + 1 < argc) {
+            nodes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--sources") == 0 && i + 1 < argc) {
+            sourceCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--graphs") == 0 && i + 1 < argc) {
+            snprintf(kinds, sizeof(kinds), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--shuffle") == 0) {
+            shuffle = 1;
+        } else if (strcmp(argv[i], "--no-simd") == 0) {
+            allowSimd = 0;
+        } else if (strcmp(argv[i], "--reorder") == 0) {
+            if (i + 1 == argc || !parseVertexOrdering(argv[i + 1], &ordering)) {
+                if (i + 1 < argc) fprintf(stderr, RED "Unknown vertex ordering: %s\n" RESET, argv[i + 1]);
+                fprintf(stderr, usage, argv[0]);
+                return 1;
+            }
+            i++;
+        } else {
+            fprintf(stderr, usage, argv[0]);
+            return 1;
+        }
+    }
+    if (nodes <= 0 || sourceCount <= 0) {
+        fprintf(stderr, usage, argv[0]);
+        return 1;
+    }
+
+    ThreadPool* pool = createThreadPool(availableCores());
+    int missCounter = openCacheMissCounter();
+    const char* kernelName;
+    RelaxKernel kernel = selectRelaxKernel(allowSimd, &kernelName);
+    fprintf(stderr, "Edge-array Bellman-Ford kernel: %s\n", kernelName);
+    LaneKernel laneKernel = selectLaneKernel(allowSimd, &kernelName);
+    if (!resetPeakResident()) {
+        fprintf(stderr, "Peak memory can't be reset per row; showing the process high-water mark\n");
+    }
+    int failures = 0;
+    printf("%-8s %9s %10s  %-22s %10s %12s %10s %12s  %s\n",
+           "graph", "nodes", "edges", "algorithm", "ms/run", "Medges/s", "peak MB", "misses/run", "check");
+
+    for (char* kind = strtok(kinds, ","); kind != NULL; kind = strtok(NULL, ",")) {
+        Graph graph = {0};
+        double start = nowSeconds();
+        if (!generateGraph(&graph, kind, nodes, seed)) {
+            fprintf(stderr, RED "Unknown graph kind: %s\n" RESET, kind);
+            failures++;
+            continue;
+        }
+        fprintf(stderr, "%s: generated in %.3f s\n", kind, nowSeconds() - start);
+
+        CSRGraph csr;
+        buildCSR(&graph, &csr);
+        int n = csr.nodeCount;
+
+        // Generators number vertices with good locality already; real inputs
+        // rarely do
+        if (shuffle) {
+            ReorderedGraph shuffled;
+            reorderCSR(&csr, ORDER_RANDOM, &shuffled);
+            freeCSR(&csr);
+            free(shuffled.newId);
+            free(shuffled.oldId);
+            csr = shuffled.csr;
+            freeGraph(&graph);
+            graphFromCSR(&csr, &graph);
+        }
+
+        // Algorithms run on the renumbered copy; results are mapped back
+        // before the check
+        const CSRGraph* work = &csr;
+        Graph* workGraph = &graph;
+        ReorderedGraph reordered;
+        Graph reorderedGraph = {0};
+        if (ordering != ORDER_NONE) {
+            double begin = nowSeconds();
+            reorderCSR(&csr, ordering, &reordered);
+            graphFromCSR(&reordered.csr, &reorderedGraph);
+            work = &reordered.csr;
+            workGraph = &reorderedGraph;
+            fprintf(stderr, "%s: reordered in %.3f s\n", kind, nowSeconds() - begin);
+        }
+
+        int delta = defaultDeltaWidth(work);
+        CSRGraph incoming;
+        buildReverseCSR(work, &incoming);
+        int* distances = (int*)malloc(n * sizeof(int));
+        int* mapped = (int*)malloc(n * sizeof(int));
+        int* prev = (int*)malloc(n * sizeof(int));
+        int* expected = (int*)malloc(n * sizeof(int));
+        int* cycle = (int*)malloc(n * sizeof(int));
+        IndexedMinHeap* heap = createIndexedMinHeap(n);
+        MonotoneQueue* dial = createMonotoneQueue(n, maxEdgeWeight(work), QUEUE_DIAL);
+        MonotoneQueue* radix = createMonotoneQueue(n, maxEdgeWeight(work), QUEUE_RADIX);
+
+        // Sources are drawn from the same seed so runs are comparable, and
+        // only from vertices with outgoing edges: R-MAT leaves many isolated
+        uint64_t sourceState = seed ^ 0x5EED;
+        int* sources = (int*)malloc(sourceCount * sizeof(int));
+        for (int k = 0; k < sourceCount; k++) {
+            int source;
+            do {
+                source = randomBelow(&sourceState, n);
+            } while (csr.edgeCount > 0 && csr.offsets[source + 1] == csr.offsets[source]);
+            sources[k] = source;
+        }
+
+        for (int a = 0; a < BENCH_ALGORITHM_COUNT; a++) {
+            if (a == BENCH_DIJKSTRA && n > BENCH_QUADRATIC_LIMIT) {
+                printf("%-8s %9d %10d  %-22s %10s %12s %10s %12s  %s\n", kind, n, csr.edgeCount,
+                       benchAlgorithmNames[a], "-", "-", "-", "-", "skipped (O(V^2))");
+                continue;
+            }
+
+            // Each row's peak starts from what is resident now: the graph,
+            // the shared buffers and memory earlier rows have not returned
+            resetPeakResident();
+            double elapsed = 0.0;
+            long long edgesScanned = 0;
+            long long misses = 0;
+            int mismatches = 0;
+
+            // The multi-source search answers every source in one timed run
+            int* matrix = NULL;
+            if (a == BENCH_MULTI_SOURCE) {
+                int* runSources = (int*)malloc(sourceCount * sizeof(int));
+                for (int k = 0; k < sourceCount; k++) {
+                    runSources[k] = work == &csr ? sources[k] : reordered.newId[sources[k]];
+                }
+                matrix = (int*)malloc((size_t)sourceCount * n * sizeof(int));
+                long long missesBefore = readCacheMissCounter(missCounter);
+                double begin = nowSeconds();
+                multiSourceDistances(work, runSources, sourceCount, matrix, laneKernel);
+                elapsed = nowSeconds() - begin;
+                misses = readCacheMissCounter(missCounter) - missesBefore;
+                free(runSources);
+            }
+
+            for (int k = 0; k < sourceCount; k++) {
+                int source = sources[k];
+                dijkstraHeapDistances(&csr, source, expected, prev, heap);
+                int runSource = work == &csr ? source : reordered.newId[source];
+
+                long long missesBefore = readCacheMissCounter(missCounter);
+                double begin = nowSeconds();
+                if (a == BENCH_MULTI_SOURCE) {
+                    memcpy(distances, matrix + (size_t)k * n, n * sizeof(int));
+                } else if (a == BENCH_DIJKSTRA) {
+                    dijkstraDistances(workGraph, runSource, distances, prev);
+                } else if (a == BENCH_BELLMAN_FORD) {
+                    bellmanFordDistances(workGraph, runSource, distances, prev);
+                } else if (a == BENCH_DIJKSTRA_HEAP) {
+                    dijkstraHeapDistances(work, runSource, distances, prev, heap);
+                } else if (a == BENCH_QUEUE_BELLMAN_FORD) {
+                    spfaDistances(work, runSource, distances, prev, cycle);
+                } else if (a == BENCH_DELTA_STEPPING) {
+                    deltaSteppingDistances(work, runSource, delta, distances, prev, pool);
+                } else if (a == BENCH_EDGE_ARRAY_BELLMAN_FORD) {
+                    bellmanFordEdgeArray(&incoming, runSource, distances, prev, kernel);
+                } else if (a == BENCH_DIAL) {
+                    dijkstraMonotoneDistances(work, runSource, distances, prev, dial);
+                } else if (a == BENCH_RADIX_HEAP) {
+                    dijkstraMonotoneDistances(work, runSource, distances, prev, radix);
+                }
+                elapsed += nowSeconds() - begin;
+                misses += readCacheMissCounter(missCounter) - missesBefore;
+
+                if (work != &csr) {
+                    restoreOriginalOrder(&reordered, distances, NULL, mapped, NULL);
+                    memcpy(distances, mapped, n * sizeof(int));
+                }
+
+                // Throughput is normalised by the edges reachable from source
+                for (int v = 0; v < n; v++) {
+                    if (distances[v] != expected[v]) mismatches++;
+                    if (expected[v] != INT_MAX) edgesScanned += csr.offsets[v + 1] - csr.offsets[v];
+                }
+            }
+            free(matrix);
+
+            double perRun = elapsed / sourceCount;
+            char missText[32] = "-";
+            if (missCounter >= 0) snprintf(missText, sizeof(missText), "%lld", misses / sourceCount);
+            printf("%-8s %9d %10d  %-22s %10.2f %12.2f %10.1f %12s  %s\n", kind, n, csr.edgeCount,
+                   benchAlgorithmNames[a], perRun * 1000.0,
+                   elapsed > 0 ? edgesScanned / elapsed / 1e6 : 0.0,
+                   peakResidentKilobytes() / 1024.0, missText, mismatches == 0 ? "ok" : "MISMATCH");
+            if (mismatches != 0) failures++;
+        }
+
+        free(sources);
+        free(mapped);
+        free(distances);
+        free(prev);
+        free(expected);
+        free(cycle);
+        freeIndexedMinHeap(heap);
+        freeMonotoneQueue(dial);
+        freeMonotoneQueue(radix);
+        freeCSR(&incoming);
+        freeCSR(&csr);
+        freeGraph(&graph);
+        if (ordering != ORDER_NONE) {
+            freeReorderedGraph(&reordered);
+            freeGraph(&reorderedGraph);
+        }
+    }
+
+    if (missCounter >= 0) close(missCounter);
+    freeThreadPool(pool);
+    if (failures > 0) {
+        fprintf(stderr, RED "%d benchmark check(s) failed.\n" RESET, failures);
+        return 1;
+    }
+    return 0;
+}
+
+int parseVertexOrdering(const char* name, VertexOrdering* ordering) {
+    if (strcmp(name, "none") == 0) {
+        *ordering = ORDER_NONE;
+    } else if (strcmp(name, "bfs") == 0) {
+        *ordering = ORDER_BFS;
+    } else if (strcmp(name, "rcm") == 0) {
+        *ordering = ORDER_RCM;
+    } else if (strcmp(name, "degree") == 0) {
+        *ordering = ORDER_DEGREE;
+    } else if (strcmp(name, "random") == 0) {
+        *ordering = ORDER_RANDOM;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static int compareUint64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Return newId[old] for the requested ordering. Edge direction is ignored:
+// a vertex is placed near both its successors and its predecessors.
+int* computeVertexOrder(const CSRGraph* csr, VertexOrdering ordering) {
+    int n = csr->nodeCount;
+    int* newId = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    for (int v = 0; v < n; v++) newId[v] = v;
+    if (ordering == ORDER_NONE) return newId;
+    if (ordering == ORDER_RANDOM) {
+        uint64_t state = 0x0DDBA11;
+        for (int v = n - 1; v > 0; v--) {
+            int other = randomBelow(&state, v + 1);
+            int temp = newId[v];
+            newId[v] = newId[other];
+            newId[other] = temp;
+        }
+        return newId;
+    }
+
+    CSRGraph reverse;
+    buildReverseCSR(csr, &reverse);
+    int* degree = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    for (int v = 0; v < n; v++) {
+        degree[v] = csr->offsets[v + 1] - csr->offsets[v] + reverse.offsets[v + 1] - reverse.offsets[v];
+    }
+
+    // Vertices as (degree, id) keys in ascending order
+    uint64_t* byDegree = (uint64_t*)malloc((n > 0 ? n : 1) * sizeof(uint64_t));
+    for (int v = 0; v < n; v++) {
+        byDegree[v] = (uint64_t)degree[v] << 32 | (uint32_t)v;
+    }
+    qsort(byDegree, n, sizeof(uint64_t), compareUint64);
+
+    int* order = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    if (ordering == ORDER_DEGREE) {
+        for (int i = 0; i < n; i++) {
+            order[i] = (int)(uint32_t)byDegree[n - 1 - i];
+        }
+    } else {
+        // BFS over the undirected view, starting each component at its
+        // lowest-degree vertex; RCM also visits neighbours by degree
+        char* visited = (char*)calloc(n > 0 ? n : 1, sizeof(char));
+        uint64_t* pending = NULL;
+        int pendingCapacity = 0;
+        int head = 0, tail = 0;
+        for (int i = 0; i < n; i++) {
+            int start = (int)(uint32_t)byDegree[i];
+            if (visited[start]) continue;
+            visited[start] = 1;
+            order[tail++] = start;
+            while (head < tail) {
+                int u = order[head++];
+                int count = 0;
+                int needed = degree[u];
+                if (needed > pendingCapacity) {
+                    pendingCapacity = needed;
+                    pending = (uint64_t*)realloc(pending, pendingCapacity * sizeof(uint64_t));
+                }
+                for (int side = 0; side < 2; side++) {
+                    const CSRGraph* view = side == 0 ? csr : &reverse;
+                    for (int k = view->offsets[u]; k < view->offsets[u + 1]; k++) {
+                        int v = view->targets[k];
+                        if (visited[v]) continue;
+                        visited[v] = 1;
+                        pending[count++] = (uint64_t)(ordering == ORDER_RCM ? degree[v] : 0) << 32 | (uint32_t)v;
+                    }
+                }
+                if (ordering == ORDER_RCM) qsort(pending, count, sizeof(uint64_t), compareUint64);
+                for (int k = 0; k < count; k++) {
+                    order[tail++] = (int)(uint32_t)pending[k];
+                }
+            }
+        }
+        free(pending);
+        free(visited);
+        if (ordering == ORDER_RCM) {
+            for (int i = 0, j = n - 1; i < j; i++, j--) {
+                int temp = order[i];
+                order[i] = order[j];
+                order[j] = temp;
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        newId[order[i]] = i;
+    }
+    free(order);
+    free(byDegree);
+    free(degree);
+    freeCSR(&reverse);
+    return newId;
+}
+
+// Copy csr under the new numbering. Each row is sorted by target so a
+// relaxation sweep walks the distance array forwards.
+void reorderCSR(const CSRGraph* csr, VertexOrdering ordering, ReorderedGraph* reordered) {
+    int n = csr->nodeCount;
+    int m = csr->edgeCount;
+    reordered->newId = computeVertexOrder(csr, ordering);
+    reordered->oldId = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    for (int v = 0; v < n; v++) {
+        reordered->oldId[reordered->newId[v]] = v;
+    }
+
+    CSRGraph* out = &reordered->csr;
+    out->nodeCount = n;
+    out->edgeCount = m;
+    out->offsets = (int*)malloc(((size_t)n + 1) * sizeof(int));
+    out->targets = (int*)malloc((m > 0 ? m : 1) * sizeof(int));
+    out->weights = (int*)malloc((m > 0 ? m : 1) * sizeof(int));
+
+    uint64_t* row = NULL;
+    int rowCapacity = 0;
+    out->offsets[0] = 0;
+    for (int i = 0; i < n; i++) {
+        int old = reordered->oldId[i];
+        int begin = csr->offsets[old], count = csr->offsets[old + 1] - begin;
+        if (count > rowCapacity) {
+            rowCapacity = count;
+            row = (uint64_t*)realloc(row, rowCapacity * sizeof(uint64_t));
+        }
+        for (int k = 0; k < count; k++) {
+            row[k] = (uint64_t)reordered->newId[csr->targets[begin + k]] << 32 | (uint32_t)csr->weights[begin + k];
+        }
+        qsort(row, count, sizeof(uint64_t), compareUint64);
+        int base = out->offsets[i];
+        for (int k = 0; k < count; k++) {
+            out->targets[base + k] = (int)(row[k] >> 32);
+            out->weights[base + k] = (int)(uint32_t)row[k];
+        }
+        out->offsets[i + 1] = base + count;
+    }
+    free(row);
+}
+
+void freeReorderedGraph(ReorderedGraph* reordered) {
+    freeCSR(&reordered->csr);
+    free(reordered->newId);
+    free(reordered->oldId);
+}
+
+// Map per-vertex results computed on the reordered graph back to original ids
+void restoreOriginalOrder(const ReorderedGraph* reordered, const int* distances, const int* prev,
+                          int* originalDistances, int* originalPrev) {
+    for (int i = 0; i < reordered->csr.nodeCount; i++) {
+        int old = reordered->oldId[i];
+        originalDistances[old] = distances[i];
+        if (originalPrev != NULL) {
+            originalPrev[old] = prev[i] == -1 ? -1 : reordered->oldId[prev[i]];
+        }
+    }
+}
+
+// Rebuild linked adjacency lists from a CSR graph. Edges are added row by row,
+// so each list occupies consecutive arena slots.
+void graphFromCSR(const CSRGraph* csr, Graph* graph) {
+    initGraph(graph, csr->nodeCount);
+    for (int u = 0; u < csr->nodeCount; u++) {
+        for (int k = csr->offsets[u + 1] - 1; k >= csr->offsets[u]; k--) {
+            addEdge(graph, u, csr->targets[k], csr->weights[k]);
+        }
+    }
+}
+
+// Hardware cache-miss counter for this thread, or -1 where the kernel or the
+// machine does not expose one (containers and most VMs)
+int openCacheMissCounter() {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+long long readCacheMissCounter(int counter) {
+    long long value = 0;
+    if (counter < 0 || read(counter, &value, sizeof(value)) != (ssize_t)sizeof(value)) return -1;
+    return value;
+}
+
+static void relaxCandidatesScalar(const int* sources, const int* weights, const int* distances,
+                                  int* candidates, int count) {
+    for (int k = 0; k < count; k++) {
+        int distance = distances[sources[k]];
+        candidates[k] = distance == INT_MAX ? INT_MAX : distance + weights[k];
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+// Eight edges per step: gather the source distances, add the weights and keep
+// INT_MAX wherever the source is unreached
+__attribute__((target("avx2")))
+static void relaxCandidatesAvx2(const int* sources, const int* weights, const int* distances,
+                                int* candidates, int count) {
+    const __m256i unreached = _mm256_set1_epi32(INT_MAX);
+    int k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m256i index = _mm256_loadu_si256((const __m256i*)(sources + k));
+        __m256i distance = _mm256_i32gather_epi32(distances, index, 4);
+        __m256i sum = _mm256_add_epi32(distance, _mm256_loadu_si256((const __m256i*)(weights + k)));
+        __m256i isUnreached = _mm256_cmpeq_epi32(distance, unreached);
+        _mm256_storeu_si256((__m256i*)(candidates + k), _mm256_blendv_epi8(sum, unreached, isUnreached));
+    }
+    relaxCandidatesScalar(sources + k, weights + k, distances, candidates + k, count - k);
+}
+#endif
+
+// Pick the widest kernel the running CPU supports. SSE4 has no gather, so
+// below AVX2 the scalar loop is as fast as anything else.
+RelaxKernel selectRelaxKernel(int allowSimd, const char** name) {
+#ifdef HAVE_X86_SIMD
+    if (allowSimd && __builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return relaxCandidatesAvx2;
+    }
+#endif
+    (void)allowSimd;
+    *name = "scalar";
+    return relaxCandidatesScalar;
+}
+
+// Bellman-Ford over incoming edges (the reverse CSR, i.e. src[]/w[] grouped by
+// destination). Each pass hands a block of destinations to the kernel, then
+// keeps the best candidate per vertex. Updates are written in place, so later
+// blocks in a pass already see them. A block is skipped when none of its
+// sources lies in the id range that changed since the block was last
+// evaluated. Returns 0 if a negative cycle is reachable from source.
+int bellmanFordEdgeArray(const CSRGraph* incoming, int source, int* distances, int* prev, RelaxKernel kernel) {
+    int n = incoming->nodeCount;
+    const int* offsets = incoming->offsets;
+    int scratch = RELAX_BLOCK_EDGES;
+    for (int v = 0; v < n; v++) {
+        if (offsets[v + 1] - offsets[v] > scratch) scratch = offsets[v + 1] - offsets[v];
+    }
+    int* candidates = (int*)malloc(scratch * sizeof(int));
+
+    // Fixed blocks of destinations with the id range of their sources
+    IntVector blockStart = {0}, sourceMin = {0}, sourceMax = {0};
+    for (int v = 0; v < n;) {
+        int base = offsets[v], low = INT_MAX, high = -1;
+        intVectorPush(&blockStart, v);
+        while (v < n && offsets[v + 1] - base <= scratch) v++;
+        for (int k = base; k < offsets[v]; k++) {
+            if (incoming->targets[k] < low) low = incoming->targets[k];
+            if (incoming->targets[k] > high) high = incoming->targets[k];
+        }
+        intVectorPush(&sourceMin, low);
+        intVectorPush(&sourceMax, high);
+    }
+    intVectorPush(&blockStart, n);
+
+    for (int v = 0; v < n; v++) {
+        distances[v] = INT_MAX;
+        prev[v] = -1;
+    }
+    distances[source] = 0;
+
+    // Ids changed in the previous pass and so far in this one. A change in
+    // pass n means some shortest path needs n edges: a negative cycle.
+    int previousLow = source, previousHigh = source;
+    int changed = 1;
+    for (int pass = 0; pass < n && changed; pass++) {
+        int currentLow = INT_MAX, currentHigh = -1;
+        changed = 0;
+        COUNT(passes);
+        for (int b = 0; b + 1 < blockStart.size; b++) {
+            int low = sourceMin.data[b], high = sourceMax.data[b];
+            if ((high < previousLow || low > previousHigh) && (high < currentLow || low > currentHigh)) continue;
+
+            int first = blockStart.data[b], last = blockStart.data[b + 1], base = offsets[first];
+            kernel(incoming->targets + base, incoming->weights + base, distances, candidates, offsets[last] - base);
+            COUNT_ADD(relaxations, offsets[last] - base);
+
+            for (int u = first; u < last; u++) {
+                int best = distances[u], bestEdge = -1;
+                for (int k = offsets[u]; k < offsets[u + 1]; k++) {
+                    if (candidates[k - base] < best) {
+                        best = candidates[k - base];
+                        bestEdge = k;
+                    }
+                }
+                if (bestEdge != -1) {
+                    COUNT(improvements);
+                    distances[u] = best;
+                    prev[u] = incoming->targets[bestEdge];
+                    if (u < currentLow) currentLow = u;
+                    if (u > currentHigh) currentHigh = u;
+                    changed = 1;
+                }
+            }
+        }
+        previousLow = currentLow;
+        previousHigh = currentHigh;
+    }
+
+    free(candidates);
+    free(blockStart.data);
+    free(sourceMin.data);
+    free(sourceMax.data);
+    return !changed;
+}
+
+static int relaxLanesScalar(const int* from, int* target, int weight, int laneCount, uint64_t* improvedLanes) {
+    int improved = INT_MAX;
+    for (int k = 0; k < laneCount; k++) {
+        if (from[k] == INT_MAX) continue;
+        int candidate = from[k] + weight;
+        if (candidate < target[k]) {
+            target[k] = candidate;
+            *improvedLanes |= 1ULL << k;
+            if (candidate < improved) improved = candidate;
+        }
+    }
+    return improved;
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("avx2")))
+static int relaxLanesAvx2(const int* from, int* target, int weight, int laneCount, uint64_t* improvedLanes) {
+    const __m256i unreached = _mm256_set1_epi32(INT_MAX);
+    const __m256i step = _mm256_set1_epi32(weight);
+    __m256i improved = unreached;
+    int k = 0;
+    for (; k + 8 <= laneCount; k += 8) {
+        __m256i source = _mm256_loadu_si256((const __m256i*)(from + k));
+        __m256i current = _mm256_loadu_si256((const __m256i*)(target + k));
+        __m256i candidate = _mm256_blendv_epi8(_mm256_add_epi32(source, step), unreached,
+                                               _mm256_cmpeq_epi32(source, unreached));
+        __m256i better = _mm256_cmpgt_epi32(current, candidate);
+        _mm256_storeu_si256((__m256i*)(target + k), _mm256_min_epi32(current, candidate));
+        improved = _mm256_min_epi32(improved, _mm256_blendv_epi8(unreached, candidate, better));
+        *improvedLanes |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(better)) << k;
+    }
+    // Horizontal minimum of the eight lanes
+    __m128i low = _mm_min_epi32(_mm256_castsi256_si128(improved), _mm256_extracti128_si256(improved, 1));
+    low = _mm_min_epi32(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(1, 0, 3, 2)));
+    low = _mm_min_epi32(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(2, 3, 0, 1)));
+    int best = _mm_cvtsi128_si32(low);
+    if (k < laneCount) {
+        uint64_t tailLanes = 0;
+        int tail = relaxLanesScalar(from + k, target + k, weight, laneCount - k, &tailLanes);
+        *improvedLanes |= tailLanes << k;
+        if (tail < best) best = tail;
+    }
+    return best;
+}
+#endif
+
+LaneKernel selectLaneKernel(int allowSimd, const char** name) {
+#ifdef HAVE_X86_SIMD
+    if (allowSimd && __builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return relaxLanesAvx2;
+    }
+#endif
+    (void)allowSimd;
+    *name = "scalar";
+    return relaxLanesScalar;
+}
+
+// One traversal for up to MULTI_SOURCE_MAX_LANES sources; lane-major result
+// in distances[v * lanes + k]
+static void multiSourceChunk(const CSRGraph* csr, const int* sources, int lanes, int* distances,
+                             uint64_t* dirty, IndexedMinHeap* heap, LaneKernel kernel) {
+    int n = csr->nodeCount;
+    for (size_t i = 0; i < (size_t)n * lanes; i++) {
+        distances[i] = INT_MAX;
+    }
+    memset(dirty, 0, n * sizeof(uint64_t));
+    heapClear(heap);
+    for (int k = 0; k < lanes; k++) {
+        distances[(size_t)sources[k] * lanes + k] = 0;
+        dirty[sources[k]] |= 1ULL << k;
+        heapPushOrDecrease(heap, sources[k], 0);
+    }
+
+    while (heap->size > 0) {
+        int u = heapPopMin(heap);
+        const int* from = distances + (size_t)u * lanes;
+        uint64_t changed = dirty[u];
+        dirty[u] = 0;
+
+        // All lanes at once when most of them moved, otherwise just the moved ones
+        int wide = __builtin_popcountll(changed) * 2 >= lanes;
+        for (int e = csr->offsets[u]; e < csr->offsets[u + 1]; e++) {
+            int v = csr->targets[e];
+            int* target = distances + (size_t)v * lanes;
+            int improved = INT_MAX;
+            if (wide) {
+                improved = kernel(from, target, csr->weights[e], lanes, &dirty[v]);
+            } else {
+                for (uint64_t bits = changed; bits != 0; bits &= bits - 1) {
+                    int k = __builtin_ctzll(bits);
+                    int candidate = from[k] + csr->weights[e];
+                    if (candidate < target[k]) {
+                        target[k] = candidate;
+                        dirty[v] |= 1ULL << k;
+                        if (candidate < improved) improved = candidate;
+                    }
+                }
+            }
+            if (improved != INT_MAX) {
+                heapPushOrDecrease(heap, v, improved);
+            }
+        }
+    }
+}
+
+// Distances from several sources with shared traversals. Each vertex keeps
+// the distances of a chunk of sources contiguously, so one adjacency scan
+// serves every lane; a vertex is queued by the smallest lane that improved and
+// relaxes only the lanes that changed since it was last popped. On return
+// matrix[k * V + v] is the distance from sources[k] to v. Returns 0 (and
+// leaves matrix alone) on a negative weight.
+int multiSourceDistances(const CSRGraph* csr, const int* sources, int sourceCount, int* matrix, LaneKernel kernel) {
+    int n = csr->nodeCount;
+    for (int k = 0; k < csr->edgeCount; k++) {
+        if (csr->weights[k] < 0) return 0;
+    }
+
+    int chunk = sourceCount < MULTI_SOURCE_MAX_LANES ? sourceCount : MULTI_SOURCE_MAX_LANES;
+    int* distances = (int*)malloc((size_t)n * (chunk > 0 ? chunk : 1) * sizeof(int));
+    uint64_t* dirty = (uint64_t*)malloc((n > 0 ? n : 1) * sizeof(uint64_t));
+    IndexedMinHeap* heap = createIndexedMinHeap(n > 0 ? n : 1);
+
+    for (int first = 0; first < sourceCount; first += chunk) {
+        int lanes = sourceCount - first < chunk ? sourceCount - first : chunk;
+        multiSourceChunk(csr, sources + first, lanes, distances, dirty, heap, kernel);
+        for (int v = 0; v < n; v++) {
+            for (int k = 0; k < lanes; k++) {
+                matrix[(size_t)(first + k) * n + v] = distances[(size_t)v * lanes + k];
+            }
+        }
+    }
+
+    freeIndexedMinHeap(heap);
+    free(dirty);
+    free(distances);
+    return 1;
+}
@@ -2,8 +2,40 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
 
 #define MAX_CHAR 256
+#define BLOCK_MAGIC "HUFB"             // Block container header
+#define INDEX_MAGIC "HUFI"             // Block container trailer
+#define CANONICAL_MAGIC "HUFC"         // Single-stream canonical code header
+#define STREAM_MAGIC "HUFS"            // Self-delimiting block stream header
+#define BLOCK_VERSION 4
+#define BLOCK_MIN_VERSION 3            // Oldest container version still decoded
+#define MAX_CODE_LENGTH 15             // Longest code the encoder emits
+#define DEFAULT_BLOCK_SIZE (1 << 20)
+#define MAX_WORKER_THREADS 64
+#define BLOCKS_PER_WORKER 4            // Blocks held in memory per worker between writes
+#define DECODE_TABLE_BITS 11           // Bits resolved per decode table lookup
+#define DECODE_MAX_SYMBOLS 4           // Symbols a single lookup may emit
+#define INTERLEAVED_STREAMS 4          // Bitstreams per block with --interleave
+#define HISTOGRAM_TABLES 4             // Count tables the histogram spreads bytes over
+#define HISTOGRAM_MIN_BYTES 4096       // Below this one table is cheaper to clear and merge
+#define BENCH_DEFAULT_BYTES (64 << 20)
+#define BLOCK_LZ77 0x80                // First block byte of an LZ77 block
+#define DEFAULT_LEVEL 6                // 0 is Huffman only, 1-9 add LZ77
+#define MAX_LEVEL 9
+#define LZ_MIN_MATCH 4
+#define LZ_WINDOW 65536                // Offsets are 16 bits, so matches reach back at most 65535 bytes
+#define LZ_HASH_BITS 16
+#define LZ_MIN_BLOCK 64                // Smaller blocks are only Huffman coded
+#define BENCH_RUNS 5
 
 // ANSI color codes
 #define RESET "\033[0m"
@@ -28,6 +60,94 @@ typedef struct MinHeap {
     Node **array;
 } MinHeap;
 
+// Decode table entry for one DECODE_TABLE_BITS-bit window: up to
+// DECODE_MAX_SYMBOLS whole codes and the bits they use, or count 0 when the
+// window's first code is longer than the table. 8 bytes, so the whole table
+// stays in L1.
+typedef struct DecodeEntry {
+    unsigned char symbols[DECODE_MAX_SYMBOLS];
+    unsigned char count;
+    unsigned char bits;
+    unsigned char unused[2];
+} DecodeEntry;
+
+// Adds the count of every byte value in data[0..size) to frequency
+typedef void (*HistogramKernel)(const unsigned char *data, size_t size, unsigned frequency[MAX_CHAR]);
+
+// MSB-first bit reader over one bitstream
+typedef struct BitReader {
+    const unsigned char *next;
+    const unsigned char *end;
+    uint64_t buffer;  // Unconsumed bits, left-aligned
+    int available;
+} BitReader;
+
+// One block of input and its encoded form (see encodeBlock). streamCount is
+// 1 or INTERLEAVED_STREAMS and level 0 to MAX_LEVEL; both only matter when
+// encoding.
+typedef struct BlockJob {
+    unsigned char *input;
+    size_t inputSize;
+    size_t inputCapacity;
+    unsigned char *output;
+    size_t outputSize;
+    size_t outputCapacity;
+    int streamCount;
+    int level;
+    bool failed;
+} BlockJob;
+
+// The byte streams an LZ77 block is split into. Each is Huffman coded on
+// its own, since literals, lengths and offset bytes have unrelated statistics.
+typedef enum LzStream {
+    LZ_LITERALS,     // Literal bytes, in order
+    LZ_TOKENS,       // Per sequence: literal count << 4 | (match length - LZ_MIN_MATCH), each capped at 15
+    LZ_OFFSET_LOW,   // Per match: low byte of the distance
+    LZ_OFFSET_HIGH,  // Per match: high byte of the distance
+    LZ_EXTRA,        // Counts that did not fit a nibble: 255s, then the rest
+    LZ_STREAMS
+} LzStream;
+
+// Match finder effort for one compression level
+typedef struct LzLevel {
+    int chainDepth;  // Hash chain entries tried per position
+    int niceLength;  // Stop searching once a match is this long
+    int lazyLength;  // Try the next position before taking a shorter match (0: never)
+} LzLevel;
+
+// Blocks handed to the workers in one round; each worker claims the next job
+typedef struct BlockRound {
+    BlockJob *jobs;
+    int jobCount;
+    int nextJob;
+    pthread_mutex_t lock;
+    void (*process)(BlockJob *job);
+} BlockRound;
+
+// Container index entry, written after the last block
+typedef struct BlockIndexEntry {
+    uint64_t offset;
+    uint32_t encodedSize;
+    uint32_t originalSize;
+} BlockIndexEntry;
+
+typedef void (*PoolTask)(void *arg, int worker);
+
+// Fixed set of worker threads that all run the same task per round. The
+// calling thread acts as worker 0, so a pool of one worker spawns no threads.
+typedef struct ThreadPool {
+    pthread_t *threads;
+    int workerCount;
+    pthread_mutex_t lock;
+    pthread_cond_t startRound;
+    pthread_cond_t roundDone;
+    PoolTask task;
+    void *arg;
+    int generation; // Bumped for every round handed to the workers
+    int pending;    // Workers still running the current round
+    int shuttingDown;
+} ThreadPool;
+
 // Function prototypes
 MinHeap* createMinHeap(unsigned capacity);
 void insertMinHeap(MinHeap *minHeap, Node *node);
@@ -35,18 +155,45 @@ Node* extractMin(MinHeap *minHeap);
 void minHeapify(MinHeap *minHeap, int idx);
 bool isSizeOne(MinHeap *minHeap);
 Node* createNode(char character, unsigned frequency);
-void printCodes(Node *root, char *arr, int top, char codes[MAX_CHAR][MAX_CHAR]);
+Node* buildHuffmanTree(const unsigned frequency[MAX_CHAR]);
+void huffmanCodeLengths(const unsigned frequency[MAX_CHAR], unsigned char lengths[MAX_CHAR]);
+void canonicalCodes(const unsigned char lengths[MAX_CHAR], uint32_t codes[MAX_CHAR]);
+size_t writeCodeLengths(const unsigned char lengths[MAX_CHAR], unsigned char *out);
+size_t readCodeLengths(const unsigned char *in, size_t size, unsigned char lengths[MAX_CHAR]);
+Node* buildCanonicalTree(const unsigned char lengths[MAX_CHAR]);
+void buildDecodeTable(Node *root, DecodeEntry *table);
+size_t decodeSymbols(Node *root, const unsigned char *bits, size_t byteCount, unsigned char *output, size_t expected);
+bool decodeInterleaved(Node *root, const unsigned char *bits, size_t byteCount, unsigned char *output, size_t expected);
 void compress(const char *inputFilePath, const char *outputFilePath);
-void decompress(const char *inputFilePath, const char *outputFilePath);
+bool decompress(const char *inputFilePath, const char *outputFilePath);
 void compareFileSizes(const char *originalFilePath, const char *compressedFilePath);
 void freeTree(Node *root);
 void printDivider();
+double nowSeconds();
+int availableCores();
+ThreadPool* createThreadPool(int workerCount);
+void threadPoolRun(ThreadPool *pool, PoolTask task, void *arg);
+void freeThreadPool(ThreadPool *pool);
+HistogramKernel selectHistogramKernel(bool allowSimd, const char **name);
+void countBytes(const unsigned char *data, size_t size, unsigned frequency[MAX_CHAR]);
+void encodeBlock(BlockJob *job);
+void decodeBlock(BlockJob *job);
+bool compressBlocks(const char *inputFilePath, const char *outputFilePath, size_t blockSize, int streamCount,
+                    int level, int threadCount);
+bool decompressBlocks(FILE *inputFile, const char *outputFilePath, int threadCount);
+bool compressStream(FILE *inputFile, FILE *outputFile, size_t blockSize, int streamCount, int level,
+                    int threadCount);
+bool decompressStream(FILE *inputFile, FILE *outputFile, int threadCount);
+int runCommandLine(int argc, char **argv);
+int runBenchmarkMode(int argc, char **argv);
 
-int main() {
+int main(int argc, char **argv) {
     char inputFilePath[256];
     char outputFilePath[256];
     char choice;
 
+    if (argc > 1) return runCommandLine(argc, argv);
+
     printDivider();
     printf(MAGENTA "Huffman Coding for File Compression\n" RESET);
     printDivider();
@@ -55,8 +202,9 @@ int main() {
         printf(BLUE "Choose an operation:\n" RESET);
         printf("1. Compress a file\n");
         printf("2. Decompress a file\n");
-        printf("3. Exit\n");
-        printf(BLUE "Enter your choice (1/2/3): " RESET);
+        printf("3. Compress a file in parallel blocks\n");
+        printf("4. Exit\n");
+        printf(BLUE "Enter your choice (1/2/3/4): " RESET);
         scanf(" %c", &choice);
 
         if (choice == '1') {
@@ -78,6 +226,15 @@ int main() {
             // compareFileSizes(inputFilePath, outputFilePath);
             // printf(GREEN "\nDecompressed from: %s to: %s\n" RESET, inputFilePath, outputFilePath);
         } else if (choice == '3') {
+            printf(BLUE "\nEnter the path of the file to compress (e.g. resources/text.txt): " RESET);
+            scanf("%s", inputFilePath);
+            printf(BLUE "Enter the output path for compressed file (e.g. resources/compressed.txt): " RESET);
+            scanf("%s", outputFilePath);
+            if (compressBlocks(inputFilePath, outputFilePath, DEFAULT_BLOCK_SIZE, 1, DEFAULT_LEVEL, availableCores())) {
+                compareFileSizes(inputFilePath, outputFilePath);
+                printf(GREEN "\nCompressed from: %s to: %s\n" RESET, inputFilePath, outputFilePath);
+            }
+        } else if (choice == '4') {
             printf(GREEN "Exiting the program...\n" RESET);
             break;
         } else {
@@ -163,178 +320,541 @@ void insertMinHeap(MinHeap *minHeap, Node *node) {
     minHeap->array[i] = node;
 }
 
-// Print the codes for characters and store them
-void printCodes(Node *root, char *arr, int top, char codes[MAX_CHAR][MAX_CHAR]) {
-    if (root->left) {
-        arr[top] = '0';
-        printCodes(root->left, arr, top + 1, codes);
+// Build the Huffman tree for a frequency table; NULL if every count is zero.
+// Encoder and decoder must build from the same table to get the same tree.
+Node* buildHuffmanTree(const unsigned frequency[MAX_CHAR]) {
+    MinHeap *minHeap = createMinHeap(MAX_CHAR);
+    for (int i = 0; i < MAX_CHAR; i++) {
+        if (frequency[i]) {
+            Node *node = createNode((char)i, frequency[i]);
+            insertMinHeap(minHeap, node);
+        }
     }
 
-    if (root->right) {
-        arr[top] = '1';
-        printCodes(root->right, arr, top + 1, codes);
+    Node *root = NULL;
+    if (minHeap->size > 0) {
+        while (minHeap->size != 1) {
+            Node *left = extractMin(minHeap);
+            Node *right = extractMin(minHeap);
+            Node *top = createNode('\0', left->frequency + right->frequency);
+            top->left = left;
+            top->right = right;
+            insertMinHeap(minHeap, top);
+        }
+        root = minHeap->array[0];
     }
+    free(minHeap->array);
+    free(minHeap);
+    return root;
+}
 
+// Record the depth of every leaf as its code length
+static void collectCodeLengths(Node *root, int depth, unsigned char lengths[MAX_CHAR]) {
     if (!root->left && !root->right) {
-        arr[top] = '\0';
-        strcpy(codes[(unsigned char)root->character], arr);
+        lengths[(unsigned char)root->character] = depth > 0 ? depth : 1;
+        return;
     }
+    collectCodeLengths(root->left, depth + 1, lengths);
+    collectCodeLengths(root->right, depth + 1, lengths);
 }
 
-// Compress the file
-void compress(const char *inputFilePath, const char *outputFilePath) {
-    int frequency[MAX_CHAR] = {0};
-    FILE *inputFile = fopen(inputFilePath, "r");
-    char c;
+// Huffman code lengths no longer than MAX_CODE_LENGTH. When the tree is too
+// deep the counts are halved (keeping every used symbol at 1 or more) and the
+// tree rebuilt; that flattens it a little at a time until it fits.
+void huffmanCodeLengths(const unsigned frequency[MAX_CHAR], unsigned char lengths[MAX_CHAR]) {
+    unsigned scaled[MAX_CHAR];
+    memcpy(scaled, frequency, sizeof(scaled));
+    while (true) {
+        memset(lengths, 0, MAX_CHAR);
+        Node *root = buildHuffmanTree(scaled);
+        if (!root) return;
+        collectCodeLengths(root, 0, lengths);
+        freeTree(root);
 
-    if (!inputFile) {
-        printf(RED "Error opening input file: %s\n" RESET, inputFilePath);
-        return;
+        int longest = 0;
+        for (int i = 0; i < MAX_CHAR; i++) {
+            if (lengths[i] > longest) longest = lengths[i];
+        }
+        if (longest <= MAX_CODE_LENGTH) return;
+        for (int i = 0; i < MAX_CHAR; i++) {
+            if (scaled[i]) scaled[i] = (scaled[i] >> 1) | 1;
+        }
     }
+}
 
-    // Count frequency of each character
-    while ((c = fgetc(inputFile)) != EOF) {
-        frequency[(unsigned char)c]++;
+// Assign canonical codes: shorter codes first, equal lengths in symbol order
+void canonicalCodes(const unsigned char lengths[MAX_CHAR], uint32_t codes[MAX_CHAR]) {
+    unsigned lengthCount[MAX_CODE_LENGTH + 1] = {0};
+    uint32_t nextCode[MAX_CODE_LENGTH + 1];
+    for (int i = 0; i < MAX_CHAR; i++) {
+        lengthCount[lengths[i]]++;
     }
-    fclose(inputFile);
+    lengthCount[0] = 0;
+    uint32_t code = 0;
+    for (int length = 1; length <= MAX_CODE_LENGTH; length++) {
+        code = (code + lengthCount[length - 1]) << 1;
+        nextCode[length] = code;
+    }
+    for (int i = 0; i < MAX_CHAR; i++) {
+        codes[i] = lengths[i] ? nextCode[lengths[i]]++ : 0;
+    }
+}
 
-    MinHeap *minHeap = createMinHeap(MAX_CHAR);
+// Run-length encode the code lengths, one byte per run: the length in the
+// high nibble and the run length minus one in the low nibble. Returns the
+// number of bytes written (at most MAX_CHAR).
+size_t writeCodeLengths(const unsigned char lengths[MAX_CHAR], unsigned char *out) {
+    size_t written = 0;
+    for (int i = 0; i < MAX_CHAR;) {
+        int run = 1;
+        while (i + run < MAX_CHAR && run < 16 && lengths[i + run] == lengths[i]) run++;
+        out[written++] = (unsigned char)(lengths[i] << 4 | (run - 1));
+        i += run;
+    }
+    return written;
+}
+
+// Read run-length encoded code lengths. Returns the bytes consumed, or 0 if
+// the runs are cut short, overrun MAX_CHAR, or do not form a complete code.
+size_t readCodeLengths(const unsigned char *in, size_t size, unsigned char lengths[MAX_CHAR]) {
+    size_t consumed = 0;
+    int filled = 0;
+    while (filled < MAX_CHAR) {
+        if (consumed == size) return 0;
+        int length = in[consumed] >> 4;
+        int run = (in[consumed] & 15) + 1;
+        consumed++;
+        if (filled + run > MAX_CHAR) return 0;
+        memset(lengths + filled, length, run);
+        filled += run;
+    }
+
+    // Complete means the codes fill the code space exactly; a lone symbol
+    // (length 1) and an empty table are the exceptions
+    uint32_t space = 0;
+    int used = 0;
     for (int i = 0; i < MAX_CHAR; i++) {
-        if (frequency[i]) {
-            Node *node = createNode((char)i, frequency[i]);
-            insertMinHeap(minHeap, node);
+        if (lengths[i]) {
+            space += 1u << (MAX_CODE_LENGTH - lengths[i]);
+            used++;
         }
     }
+    if (used > 1 && space != 1u << MAX_CODE_LENGTH) return 0;
+    if (used == 1 && space != 1u << (MAX_CODE_LENGTH - 1)) return 0;
+    return consumed;
+}
 
-    // Build the Huffman Tree
-    while (minHeap->size != 1) {
-        Node *left = extractMin(minHeap);
-        Node *right = extractMin(minHeap);
-        Node *top = createNode('\0', left->frequency + right->frequency);
-        top->left = left;
-        top->right = right;
-        insertMinHeap(minHeap, top);
+// Build the decoding tree from complete canonical code lengths; NULL if no
+// symbol has a code. A lone symbol becomes a leaf root.
+Node* buildCanonicalTree(const unsigned char lengths[MAX_CHAR]) {
+    uint32_t codes[MAX_CHAR];
+    canonicalCodes(lengths, codes);
+
+    int used = 0, last = 0;
+    for (int i = 0; i < MAX_CHAR; i++) {
+        if (lengths[i]) {
+            used++;
+            last = i;
+        }
     }
+    if (used == 0) return NULL;
+    if (used == 1) return createNode((char)last, 0);
 
-    // Generate codes
-    char arr[MAX_CHAR];
-    char codes[MAX_CHAR][MAX_CHAR];
-    printCodes(minHeap->array[0], arr, 0, codes);
+    Node *root = createNode('\0', 0);
+    for (int i = 0; i < MAX_CHAR; i++) {
+        Node *current = root;
+        for (int b = lengths[i] - 1; b >= 0; b--) {
+            Node **child = (codes[i] >> b) & 1 ? &current->right : &current->left;
+            if (!*child) *child = createNode(b == 0 ? (char)i : '\0', 0);
+            current = *child;
+        }
+    }
+    return root;
+}
 
-    // Write the compressed data to the output file
-    FILE *outputFile = fopen(outputFilePath, "wb");
-    if (!outputFile) {
-        printf(RED "Error opening output file: %s\n" RESET, outputFilePath);
-        return;
+// Fill the decode table by walking the tree along every possible window of
+// DECODE_TABLE_BITS bits. The tree must have at least two leaves.
+void buildDecodeTable(Node *root, DecodeEntry *table) {
+    for (int window = 0; window < (1 << DECODE_TABLE_BITS); window++) {
+        DecodeEntry *entry = &table[window];
+        Node *current = root;
+        entry->count = 0;
+        entry->bits = 0;
+        for (int b = DECODE_TABLE_BITS - 1; b >= 0; b--) {
+            current = (window >> b) & 1 ? current->right : current->left;
+            if (!current->left && !current->right) {
+                entry->symbols[entry->count++] = (unsigned char)current->character;
+                entry->bits = DECODE_TABLE_BITS - b;
+                current = root;
+                if (entry->count == DECODE_MAX_SYMBOLS) break;
+            }
+        }
     }
+}
 
-    // Write frequency data for decompression
-    fwrite(frequency, sizeof(int), MAX_CHAR, outputFile);
+static uint64_t loadBigEndian64(const unsigned char *bytes) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return __builtin_bswap64(word);
+}
 
-    // Write encoded data
-    inputFile = fopen(inputFilePath, "r");
-    if (!inputFile) {
-        printf(RED "Error opening input file for encoding: %s\n" RESET, inputFilePath);
-        fclose(outputFile);
-        return;
+// One table step: refill the buffer to 56+ bits with a single load (the
+// reader must have at least 8 bytes left), then emit the entry's symbols.
+// All DECODE_MAX_SYMBOLS bytes of output are written, so the caller keeps
+// that much room. Codes longer than the table are found by walking the tree
+// over the buffered bits. Returns the symbols decoded, or 0 without
+// consuming anything if the code is longer than the buffered bits, which
+// only a very deep legacy tree can produce.
+static inline size_t decodeStep(Node *root, const DecodeEntry *table, BitReader *reader, unsigned char *output) {
+    reader->buffer |= loadBigEndian64(reader->next) >> reader->available;
+    reader->next += (63 - reader->available) >> 3;
+    reader->available |= 56;
+
+    const DecodeEntry *entry = &table[reader->buffer >> (64 - DECODE_TABLE_BITS)];
+    if (entry->count > 0) {
+        memcpy(output, entry->symbols, DECODE_MAX_SYMBOLS);
+        reader->buffer <<= entry->bits;
+        reader->available -= entry->bits;
+        return entry->count;
     }
 
-    unsigned char buffer = 0;
-    int bitCount = 0;
+    // Long code
+    Node *current = root;
+    int used = 0;
+    while (current->left || current->right) {
+        if (used == reader->available) return 0;
+        current = (reader->buffer << used) >> 63 ? current->right : current->left;
+        used++;
+    }
+    reader->buffer <<= used;
+    reader->available -= used;
+    *output = (unsigned char)current->character;
+    return 1;
+}
 
-    while ((c = fgetc(inputFile)) != EOF) {
-        const char *code = codes[(unsigned char)c];
-        for (int i = 0; code[i] != '\0'; i++) {
-            buffer = (buffer << 1) | (code[i] - '0');
-            bitCount++;
-            if (bitCount == 8) {
-                fwrite(&buffer, sizeof(unsigned char), 1, outputFile);
-                buffer = 0;
-                bitCount = 0;
-            }
+// How many decodeStep calls are safe in a row: each reads at most 7 bytes
+// and writes at most DECODE_MAX_SYMBOLS symbols
+static size_t safeSteps(const BitReader *reader, const unsigned char *output, const unsigned char *end) {
+    size_t bytes = reader->end - reader->next;
+    size_t steps = bytes < 8 ? 0 : (bytes - 8) / 7 + 1;
+    size_t room = (end - output) / DECODE_MAX_SYMBOLS;
+    return room < steps ? room : steps;
+}
+
+// Decode expected symbols from one reader: table steps while there is room
+// for them, then bit by bit through the buffered bits and the last bytes.
+// Returns how many were decoded; fewer than expected means the bits ran out.
+static size_t decodeRun(Node *root, const DecodeEntry *table, BitReader reader, unsigned char *output,
+                        size_t expected) {
+    size_t produced = 0;
+    while (expected - produced >= DECODE_MAX_SYMBOLS && reader.end - reader.next >= 8) {
+        size_t count = decodeStep(root, table, &reader, output + produced);
+        if (count == 0) break;
+        produced += count;
+    }
+
+    Node *current = root;
+    while (produced < expected) {
+        if (reader.available == 0) {
+            if (reader.next == reader.end) break;
+            reader.buffer = (uint64_t)*reader.next++ << 56;
+            reader.available = 8;
+        }
+        current = reader.buffer >> 63 ? current->right : current->left;
+        reader.buffer <<= 1;
+        reader.available--;
+        if (!current->left && !current->right) {
+            output[produced++] = (unsigned char)current->character;
+            current = root;
         }
     }
+    return produced;
+}
 
-    // Write any remaining bits
-    if (bitCount > 0) {
-        buffer <<= (8 - bitCount); // Pad with zeros
-        fwrite(&buffer, sizeof(unsigned char), 1, outputFile);
+// Decode expected symbols from MSB-first bits into output and return how many
+// were decoded; fewer than expected means the bits ran out.
+size_t decodeSymbols(Node *root, const unsigned char *bits, size_t byteCount, unsigned char *output, size_t expected) {
+    if (!root) return 0;
+    if (!root->left && !root->right) {
+        // A single symbol needs no bits
+        memset(output, (unsigned char)root->character, expected);
+        return expected;
     }
 
-    fclose(inputFile);
-    fclose(outputFile);
+    DecodeEntry table[1 << DECODE_TABLE_BITS];
+    buildDecodeTable(root, table);
+    BitReader reader = {bits, bits + byteCount, 0, 0};
+    return decodeRun(root, table, reader, output, expected);
+}
 
-    // Compare the sizes of the input and output files
-            compareFileSizes(inputFilePath, outputFilePath);
-            printf(GREEN "\nCompressed from: %s to: %s\n" RESET, inputFilePath, outputFilePath);
+// Decode INTERLEAVED_STREAMS bitstreams, one per consecutive quarter of the
+// output (the last may be shorter). bits starts with the byte sizes of all
+// streams but the last as uint32s. The streams are stepped in lockstep: each
+// step only depends on its own stream, so the CPU overlaps the four
+// dependency chains instead of waiting on one. Returns false if malformed.
+bool decodeInterleaved(Node *root, const unsigned char *bits, size_t byteCount, unsigned char *output, size_t expected) {
+    if (!root) return expected == 0;
+    if (!root->left && !root->right) {
+        memset(output, (unsigned char)root->character, expected);
+        return true;
+    }
 
-    // Free memory
-    freeTree(minHeap->array[0]);
-    free(minHeap->array);
-    free(minHeap);
+    uint32_t sizes[INTERLEAVED_STREAMS - 1];
+    size_t jumpSize = sizeof(sizes);
+    if (byteCount < jumpSize) return false;
+    memcpy(sizes, bits, jumpSize);
+
+    BitReader readers[INTERLEAVED_STREAMS];
+    unsigned char *outputs[INTERLEAVED_STREAMS];
+    size_t remaining[INTERLEAVED_STREAMS];
+    size_t quarter = (expected + INTERLEAVED_STREAMS - 1) / INTERLEAVED_STREAMS;
+    const unsigned char *next = bits + jumpSize;
+    const unsigned char *end = bits + byteCount;
+    for (int i = 0; i < INTERLEAVED_STREAMS; i++) {
+        size_t size = i < INTERLEAVED_STREAMS - 1 ? sizes[i] : (size_t)(end - next);
+        if (size > (size_t)(end - next)) return false;
+        readers[i] = (BitReader){next, next + size, 0, 0};
+        next += size;
+        size_t first = quarter * i < expected ? quarter * i : expected;
+        outputs[i] = output + first;
+        remaining[i] = expected - first < quarter ? expected - first : quarter;
+    }
+
+    DecodeEntry table[1 << DECODE_TABLE_BITS];
+    buildDecodeTable(root, table);
+
+    // The streams step in lockstep for as long as every one has the room and
+    // input for the whole batch, so the bound checks run once per batch. The
+    // readers live in locals so the symbol stores cannot alias them.
+    BitReader reader0 = readers[0], reader1 = readers[1], reader2 = readers[2], reader3 = readers[3];
+    unsigned char *output0 = outputs[0], *output1 = outputs[1], *output2 = outputs[2], *output3 = outputs[3];
+    unsigned char *ends[INTERLEAVED_STREAMS];
+    for (int i = 0; i < INTERLEAVED_STREAMS; i++) {
+        ends[i] = outputs[i] + remaining[i];
+    }
+    bool stalled = false;
+    while (!stalled) {
+        size_t steps = safeSteps(&reader0, output0, ends[0]);
+        size_t limit = safeSteps(&reader1, output1, ends[1]);
+        if (limit < steps) steps = limit;
+        limit = safeSteps(&reader2, output2, ends[2]);
+        if (limit < steps) steps = limit;
+        limit = safeSteps(&reader3, output3, ends[3]);
+        if (limit < steps) steps = limit;
+        if (steps == 0) break;
+
+        for (size_t step = 0; step < steps && !stalled; step++) {
+            size_t count0 = decodeStep(root, table, &reader0, output0);
+            size_t count1 = decodeStep(root, table, &reader1, output1);
+            size_t count2 = decodeStep(root, table, &reader2, output2);
+            size_t count3 = decodeStep(root, table, &reader3, output3);
+            output0 += count0;
+            output1 += count1;
+            output2 += count2;
+            output3 += count3;
+            stalled = count0 == 0 || count1 == 0 || count2 == 0 || count3 == 0;
+        }
+    }
+    readers[0] = reader0;
+    readers[1] = reader1;
+    readers[2] = reader2;
+    readers[3] = reader3;
+    outputs[0] = output0;
+    outputs[1] = output1;
+    outputs[2] = output2;
+    outputs[3] = output3;
+
+    // Streams finish one at a time
+    for (int i = 0; i < INTERLEAVED_STREAMS; i++) {
+        size_t left = ends[i] - outputs[i];
+        if (decodeRun(root, table, readers[i], outputs[i], left) != left) return false;
+    }
+    return true;
+}
+
+// Grow job->output to hold size bytes. Marks the job failed if memory runs out.
+static bool reserveOutput(BlockJob *job, size_t size) {
+    if (size > job->outputCapacity) {
+        unsigned char *output = (unsigned char *)realloc(job->output, size);
+        if (!output) {
+            job->failed = true;
+            return false;
+        }
+        job->output = output;
+        job->outputCapacity = size;
+    }
+    return true;
+}
+
+// Read from the current position to the end of the file into a new buffer
+static unsigned char* readRemaining(FILE *file, size_t *size) {
+    long start = ftell(file);
+    fseek(file, 0, SEEK_END);
+    size_t byteCount = (size_t)(ftell(file) - start);
+    fseek(file, start, SEEK_SET);
+    unsigned char *bytes = (unsigned char *)malloc(byteCount > 0 ? byteCount : 1);
+    *size = fread(bytes, 1, byteCount, file);
+    return bytes;
 }
 
-// Decompress the file
-void decompress(const char *inputFilePath, const char *outputFilePath) {
+// Compress the file: CANONICAL_MAGIC, the uint64 original size, then the
+// file encoded as a single block
+void compress(const char *inputFilePath, const char *outputFilePath) {
     FILE *inputFile = fopen(inputFilePath, "rb");
     if (!inputFile) {
-        printf(RED "Error opening compressed file: %s\n" RESET, inputFilePath);
+        printf(RED "Error opening input file: %s\n" RESET, inputFilePath);
         return;
     }
 
-    // Read frequency data
-    int frequency[MAX_CHAR];
-    fread(frequency, sizeof(int), MAX_CHAR, inputFile);
-
-    MinHeap *minHeap = createMinHeap(MAX_CHAR);
-    for (int i = 0; i < MAX_CHAR; i++) {
-        if (frequency[i]) {
-            Node *node = createNode((char)i, frequency[i]);
-            insertMinHeap(minHeap, node);
-        }
+    BlockJob job = {0};
+    job.level = DEFAULT_LEVEL;
+    job.input = readRemaining(inputFile, &job.inputSize);
+    fclose(inputFile);
+    if (job.inputSize == 0) {
+        printf(RED "Input file is empty: %s\n" RESET, inputFilePath);
+        free(job.input);
+        return;
     }
 
-    // Build the Huffman Tree
-    while (minHeap->size != 1) {
-        Node *left = extractMin(minHeap);
-        Node *right = extractMin(minHeap);
-        Node *top = createNode('\0', left->frequency + right->frequency);
-        top->left = left;
-        top->right = right;
-        insertMinHeap(minHeap, top);
+    // Find matches, build the code lengths and encode the data
+    encodeBlock(&job);
+    if (job.failed) {
+        printf(RED "Not enough memory to compress: %s\n" RESET, inputFilePath);
+        free(job.input);
+        free(job.output);
+        return;
     }
 
-    // Decode the data
-    FILE *outputFile = fopen(outputFilePath, "w");
+    // Write the compressed data to the output file
+    FILE *outputFile = fopen(outputFilePath, "wb");
     if (!outputFile) {
-        printf(RED "Error opening output file for decompression: %s\n" RESET, outputFilePath);
-        fclose(inputFile);
+        printf(RED "Error opening output file: %s\n" RESET, outputFilePath);
+        free(job.input);
+        free(job.output);
         return;
     }
+    uint64_t originalSize = job.inputSize;
+    fwrite(CANONICAL_MAGIC, 1, 4, outputFile);
+    fwrite(&originalSize, sizeof(originalSize), 1, outputFile);
+    fwrite(job.output, 1, job.outputSize, outputFile);
+    fclose(outputFile);
+    free(job.input);
+    free(job.output);
 
-    Node *current = minHeap->array[0];
-    unsigned char buffer;
-    while (fread(&buffer, sizeof(unsigned char), 1, inputFile)) {
-        for (int i = 0; i < 8; i++) {
-            current = (buffer & (1 << (7 - i))) ? current->right : current->left;
-            if (!current->left && !current->right) {
-                fputc(current->character, outputFile);
-                current = minHeap->array[0]; // Go back to the root
-            }
+    // Compare the sizes of the input and output files
+    compareFileSizes(inputFilePath, outputFilePath);
+    printf(GREEN "\nCompressed from: %s to: %s\n" RESET, inputFilePath, outputFilePath);
+}
+
+// Decompress the file. Returns false if it could not be read or written.
+bool decompress(const char *inputFilePath, const char *outputFilePath) {
+    FILE *inputFile = fopen(inputFilePath, "rb");
+    if (!inputFile) {
+        printf(RED "Error opening compressed file: %s\n" RESET, inputFilePath);
+        return false;
+    }
+
+    // Block containers, block streams and canonical streams start with a
+    // magic; the original format starts straight with the frequency table
+    char magic[4];
+    bool hasMagic = fread(magic, 1, 4, inputFile) == 4;
+    if (hasMagic && (memcmp(magic, BLOCK_MAGIC, 4) == 0 || memcmp(magic, STREAM_MAGIC, 4) == 0)) {
+        bool ok;
+        if (memcmp(magic, BLOCK_MAGIC, 4) == 0) {
+            ok = decompressBlocks(inputFile, outputFilePath, availableCores());
+        } else {
+            FILE *outputFile = fopen(outputFilePath, "wb");
+            ok = outputFile && decompressStream(inputFile, outputFile, availableCores());
+            if (!outputFile) printf(RED "Error opening output file for decompression: %s\n" RESET, outputFilePath);
+            if (outputFile && fclose(outputFile) != 0) ok = false;
+        }
+        fclose(inputFile);
+        if (ok) {
+            compareFileSizes(inputFilePath, outputFilePath);
+            printf(GREEN "\nDecompressed from: %s to: %s\n" RESET, inputFilePath, outputFilePath);
         }
+        return ok;
     }
 
-    fclose(inputFile);
-    fclose(outputFile);
+    BlockJob job = {0};
+    if (hasMagic && memcmp(magic, CANONICAL_MAGIC, 4) == 0) {
+        uint64_t originalSize;
+        if (fread(&originalSize, sizeof(originalSize), 1, inputFile) != 1) {
+            printf(RED "Compressed file is truncated: %s\n" RESET, inputFilePath);
+            fclose(inputFile);
+            return false;
+        }
+        // Sizes beyond half the address space can never be allocated
+        if (originalSize > SIZE_MAX / 2) {
+            printf(RED "Compressed file is truncated or damaged: %s\n" RESET, inputFilePath);
+            fclose(inputFile);
+            return false;
+        }
+        job.input = readRemaining(inputFile, &job.inputSize);
+        job.outputSize = originalSize;
+        fclose(inputFile);
+        decodeBlock(&job);
+    } else {
+        // Read frequency data
+        unsigned frequency[MAX_CHAR];
+        rewind(inputFile);
+        if (fread(frequency, sizeof(unsigned), MAX_CHAR, inputFile) != MAX_CHAR) {
+            printf(RED "Compressed file is truncated: %s\n" RESET, inputFilePath);
+            fclose(inputFile);
+            return false;
+        }
+
+        // Build the Huffman Tree
+        Node *root = buildHuffmanTree(frequency);
+        if (!root) {
+            printf(RED "Compressed file has no symbols: %s\n" RESET, inputFilePath);
+            fclose(inputFile);
+            return false;
+        }
+
+        // The frequencies add up to the symbol count, so the zero padding
+        // after the last code is never decoded
+        job.input = readRemaining(inputFile, &job.inputSize);
+        fclose(inputFile);
+        for (int i = 0; i < MAX_CHAR; i++) {
+            job.outputSize += frequency[i];
+        }
+
+        // Every code is at least one bit unless there is only one symbol,
+        // so a larger total comes from a damaged or foreign file
+        bool singleSymbol = !root->left && !root->right;
+        job.failed = !singleSymbol && job.outputSize / 8 > job.inputSize;
+        if (!job.failed && reserveOutput(&job, job.outputSize > 0 ? job.outputSize : 1)) {
+            job.failed = decodeSymbols(root, job.input, job.inputSize, job.output, job.outputSize) != job.outputSize;
+        }
+        freeTree(root);
+    }
+    free(job.input);
+    if (job.failed) {
+        printf(RED "Compressed file is truncated or damaged: %s\n" RESET, inputFilePath);
+        free(job.output);
+        return false;
+    }
+
+    // Write the decoded data
+    FILE *outputFile = fopen(outputFilePath, "wb");
+    if (!outputFile) {
+        printf(RED "Error opening output file for decompression: %s\n" RESET, outputFilePath);
+        free(job.output);
+        return false;
+    }
+    bool ok = fwrite(job.output, 1, job.outputSize, outputFile) == job.outputSize;
+    free(job.output);
+    if (fclose(outputFile) != 0) ok = false;
+    if (!ok) {
+        printf(RED "Error writing decompressed file: %s\n" RESET, outputFilePath);
+        return false;
+    }
 
     // Display sizes of compressed and decompressed files
     compareFileSizes(inputFilePath, outputFilePath);
     printf(GREEN "\nDecompressed from: %s to: %s\n" RESET, inputFilePath, outputFilePath);
-
-    // Free memory
-    freeTree(minHeap->array[0]);
-    free(minHeap->array);
-    free(minHeap);
+    return true;
 }
 
 // Compare file sizes
@@ -360,4 +880,1212 @@ void freeTree(Node *root) {
         freeTree(root->right);
         free(root);
     }
-}
\ No newline at end of file
+}
+// Monotonic wall-clock time in seconds
+double nowSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Number of online cores, capped at MAX_WORKER_THREADS
+int availableCores() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) return 1;
+    return cores > MAX_WORKER_THREADS ? MAX_WORKER_THREADS : (int)cores;
+}
+
+typedef struct PoolWorkerStart {
+    ThreadPool *pool;
+    int worker;
+} PoolWorkerStart;
+
+static void* poolWorkerMain(void *arg) {
+    PoolWorkerStart start = *(PoolWorkerStart *)arg;
+    free(arg);
+    ThreadPool *pool = start.pool;
+    int seenGeneration = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (!pool->shuttingDown && pool->generation == seenGeneration) {
+            pthread_cond_wait(&pool->startRound, &pool->lock);
+        }
+        if (pool->shuttingDown) break;
+        seenGeneration = pool->generation;
+        PoolTask task = pool->task;
+        void *taskArg = pool->arg;
+        pthread_mutex_unlock(&pool->lock);
+
+        task(taskArg, start.worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            pthread_cond_signal(&pool->roundDone);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+ThreadPool* createThreadPool(int workerCount) {
+    ThreadPool *pool = (ThreadPool *)calloc(1, sizeof(ThreadPool));
+    pool->workerCount = workerCount < 1 ? 1 : workerCount;
+    pool->threads = (pthread_t *)malloc(pool->workerCount * sizeof(pthread_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->startRound, NULL);
+    pthread_cond_init(&pool->roundDone, NULL);
+
+    for (int i = 1; i < pool->workerCount; i++) {
+        PoolWorkerStart *start = (PoolWorkerStart *)malloc(sizeof(PoolWorkerStart));
+        start->pool = pool;
+        start->worker = i;
+        if (pthread_create(&pool->threads[i], NULL, poolWorkerMain, start) != 0) {
+            // Run with the workers we managed to start
+            free(start);
+            pool->workerCount = i;
+            break;
+        }
+    }
+    return pool;
+}
+
+// Run task on every worker (the caller is worker 0) and wait for all of them
+void threadPoolRun(ThreadPool *pool, PoolTask task, void *arg) {
+    if (pool->workerCount > 1) {
+        pthread_mutex_lock(&pool->lock);
+        pool->task = task;
+        pool->arg = arg;
+        pool->pending = pool->workerCount - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->startRound);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    task(arg, 0);
+
+    if (pool->workerCount > 1) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->pending > 0) {
+            pthread_cond_wait(&pool->roundDone, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+void freeThreadPool(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shuttingDown = 1;
+    pthread_cond_broadcast(&pool->startRound);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->workerCount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->startRound);
+    pthread_cond_destroy(&pool->roundDone);
+    free(pool->threads);
+    free(pool);
+}
+
+// One count table: a run of equal bytes makes every increment wait for the
+// previous store to the same counter
+static void countBytesSingle(const unsigned char *data, size_t size, unsigned frequency[MAX_CHAR]) {
+    for (size_t i = 0; i < size; i++) {
+        frequency[data[i]]++;
+    }
+}
+
+// Count the 8 bytes of word, consecutive bytes going to different tables
+static inline void countWord(uint32_t tables[HISTOGRAM_TABLES][MAX_CHAR], uint64_t word) {
+    tables[0][word & 255]++;
+    tables[1][(word >> 8) & 255]++;
+    tables[2][(word >> 16) & 255]++;
+    tables[3][(word >> 24) & 255]++;
+    tables[0][(word >> 32) & 255]++;
+    tables[1][(word >> 40) & 255]++;
+    tables[2][(word >> 48) & 255]++;
+    tables[3][word >> 56]++;
+}
+
+static void mergeTables(uint32_t tables[HISTOGRAM_TABLES][MAX_CHAR], unsigned frequency[MAX_CHAR]) {
+    for (int c = 0; c < MAX_CHAR; c++) {
+        frequency[c] += tables[0][c] + tables[1][c] + tables[2][c] + tables[3][c];
+    }
+}
+
+// HISTOGRAM_TABLES interleaved tables, merged at the end, so repeated bytes
+// hit independent counters; bytes are read a 64-bit word at a time
+static void countBytesInterleaved(const unsigned char *data, size_t size, unsigned frequency[MAX_CHAR]) {
+    if (size < HISTOGRAM_MIN_BYTES) {
+        countBytesSingle(data, size, frequency);
+        return;
+    }
+    uint32_t tables[HISTOGRAM_TABLES][MAX_CHAR] = {{0}};
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        uint64_t first, second;
+        memcpy(&first, data + i, sizeof(first));
+        memcpy(&second, data + i + 8, sizeof(second));
+        countWord(tables, first);
+        countWord(tables, second);
+    }
+    mergeTables(tables, frequency);
+    countBytesSingle(data + i, size - i, frequency);
+}
+
+#ifdef HAVE_X86_SIMD
+// The interleaved tables, plus one compare per 32 bytes: a chunk that is a
+// single repeated byte is counted with one add instead of 32 increments
+__attribute__((target("avx2")))
+static void countBytesAvx2(const unsigned char *data, size_t size, unsigned frequency[MAX_CHAR]) {
+    if (size < HISTOGRAM_MIN_BYTES) {
+        countBytesSingle(data, size, frequency);
+        return;
+    }
+    uint32_t tables[HISTOGRAM_TABLES][MAX_CHAR] = {{0}};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i repeated = _mm256_set1_epi8((char)data[i]);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, repeated)) == -1) {
+            tables[0][data[i]] += 32;
+            continue;
+        }
+        for (int k = 0; k < 32; k += 8) {
+            uint64_t word;
+            memcpy(&word, data + i + k, sizeof(word));
+            countWord(tables, word);
+        }
+    }
+    mergeTables(tables, frequency);
+    countBytesSingle(data + i, size - i, frequency);
+}
+#endif
+
+// Pick the widest histogram the running CPU supports
+HistogramKernel selectHistogramKernel(bool allowSimd, const char **name) {
+#ifdef HAVE_X86_SIMD
+    if (allowSimd && __builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return countBytesAvx2;
+    }
+#endif
+    (void)allowSimd;
+    *name = "interleaved";
+    return countBytesInterleaved;
+}
+
+void countBytes(const unsigned char *data, size_t size, unsigned frequency[MAX_CHAR]) {
+    const char *name;
+    selectHistogramKernel(true, &name)(data, size, frequency);
+}
+
+// Write the codes of count symbols as MSB-first bits, zero padded to a
+// byte, and return the end of the output. Codes collect in the low bits of a
+// 64-bit register and leave as whole 32-bit big-endian words; at most
+// 31 + MAX_CODE_LENGTH bits are pending.
+static unsigned char* writeSymbols(const unsigned char *input, size_t count, const unsigned char lengths[MAX_CHAR],
+                                   const uint32_t codes[MAX_CHAR], unsigned char *out) {
+    uint64_t buffer = 0;
+    int bitCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        unsigned char symbol = input[i];
+        buffer = (buffer << lengths[symbol]) | codes[symbol];
+        bitCount += lengths[symbol];
+        if (bitCount >= 32) {
+            bitCount -= 32;
+            uint32_t word = __builtin_bswap32((uint32_t)(buffer >> bitCount));
+            memcpy(out, &word, sizeof(word));
+            out += sizeof(word);
+        }
+    }
+    while (bitCount >= 8) {
+        bitCount -= 8;
+        *out++ = (unsigned char)(buffer >> bitCount);
+    }
+    if (bitCount > 0) {
+        *out++ = (unsigned char)(buffer << (8 - bitCount)); // Pad with zeros
+    }
+    return out;
+}
+
+// Huffman code job->input into job->output: a stream count byte, the run-length
+// encoded canonical code lengths, then the bits. With INTERLEAVED_STREAMS
+// streams each quarter of the block gets its own bitstream, preceded by the
+// uint32 byte sizes of all but the last. A lone symbol needs no bits at all
+// and is always written as one stream.
+static void encodeHuffmanBlock(BlockJob *job) {
+    unsigned frequency[MAX_CHAR] = {0};
+    countBytes(job->input, job->inputSize, frequency);
+
+    unsigned char lengths[MAX_CHAR];
+    uint32_t codes[MAX_CHAR];
+    huffmanCodeLengths(frequency, lengths);
+    canonicalCodes(lengths, codes);
+
+    int used = 0;
+    size_t bitTotal = 0;
+    for (int i = 0; i < MAX_CHAR; i++) {
+        if (frequency[i]) used++;
+        bitTotal += (size_t)frequency[i] * lengths[i];
+    }
+    int streamCount = used < 2 || job->streamCount != INTERLEAVED_STREAMS ? 1 : INTERLEAVED_STREAMS;
+
+    // Each stream pads to a byte and all but the last have a uint32 size
+    job->failed = false;
+    if (!reserveOutput(job, 1 + MAX_CHAR + (bitTotal + 7) / 8 + (streamCount - 1) * (sizeof(uint32_t) + 1))) return;
+    unsigned char *out = job->output;
+    *out++ = (unsigned char)streamCount;
+    out += writeCodeLengths(lengths, out);
+    if (used < 2) {
+        job->outputSize = out - job->output;
+        return;
+    }
+
+    if (streamCount == 1) {
+        out = writeSymbols(job->input, job->inputSize, lengths, codes, out);
+    } else {
+        unsigned char *sizes = out;
+        out += (INTERLEAVED_STREAMS - 1) * sizeof(uint32_t);
+        size_t quarter = (job->inputSize + INTERLEAVED_STREAMS - 1) / INTERLEAVED_STREAMS;
+        for (int i = 0; i < INTERLEAVED_STREAMS; i++) {
+            size_t first = quarter * i < job->inputSize ? quarter * i : job->inputSize;
+            size_t count = job->inputSize - first < quarter ? job->inputSize - first : quarter;
+            unsigned char *streamEnd = writeSymbols(job->input + first, count, lengths, codes, out);
+            if (i < INTERLEAVED_STREAMS - 1) {
+                uint32_t size = (uint32_t)(streamEnd - out);
+                memcpy(sizes + i * sizeof(uint32_t), &size, sizeof(size));
+            }
+            out = streamEnd;
+        }
+    }
+    job->outputSize = out - job->output;
+}
+
+// Decode a Huffman coded block (see encodeHuffmanBlock) into job->output.
+// outputSize must hold the original size on entry. Sets failed if malformed.
+static void decodeHuffmanBlock(BlockJob *job) {
+    unsigned char lengths[MAX_CHAR];
+    size_t expected = job->outputSize;
+    job->failed = true;
+    if (job->inputSize < 1) return;
+    int streamCount = job->input[0];
+    if (streamCount != 1 && streamCount != INTERLEAVED_STREAMS) return;
+    size_t headerSize = readCodeLengths(job->input + 1, job->inputSize - 1, lengths);
+    if (headerSize == 0) return;
+    headerSize += 1;
+    const unsigned char *bits = job->input + headerSize;
+    size_t byteCount = job->inputSize - headerSize;
+
+    // Every code is at least one bit unless there is only one symbol, so a
+    // larger original size comes from a damaged header
+    int used = 0;
+    for (int i = 0; i < MAX_CHAR; i++) {
+        if (lengths[i]) used++;
+    }
+    if (used > 1 && expected / 8 > byteCount) return;
+    if (!reserveOutput(job, expected > 0 ? expected : 1)) return;
+
+    Node *root = buildCanonicalTree(lengths);
+    if (streamCount == 1) {
+        job->failed = decodeSymbols(root, bits, byteCount, job->output, expected) != expected;
+    } else {
+        job->failed = !decodeInterleaved(root, bits, byteCount, job->output, expected);
+    }
+    freeTree(root);
+}
+
+static const LzLevel lzLevels[MAX_LEVEL + 1] = {
+    {0, 0, 0},      {4, 16, 0},      {8, 32, 0},       {16, 32, 0},      {16, 32, 16},
+    {32, 64, 32},   {64, 128, 128},  {256, 256, 256},  {512, 258, 258},  {4096, 258, 258},
+};
+
+static inline uint32_t lzHash(const unsigned char *bytes, int hashBits) {
+    uint32_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return (word * 2654435761u) >> (32 - hashBits);
+}
+
+// Length of the common prefix of a and b, at most limit bytes
+static inline size_t matchLength(const unsigned char *a, const unsigned char *b, size_t limit) {
+    size_t length = 0;
+    while (length + 8 <= limit) {
+        uint64_t x, y;
+        memcpy(&x, a + length, sizeof(x));
+        memcpy(&y, b + length, sizeof(y));
+        if (x != y) return length + (__builtin_ctzll(x ^ y) >> 3);
+        length += 8;
+    }
+    while (length < limit && a[length] == b[length]) length++;
+    return length;
+}
+
+// Hash chains over the block: head holds the latest position per hash and
+// previous the position before it with the same hash, in a ring as large as
+// the window (or the block, if smaller)
+typedef struct LzChains {
+    int32_t *head;
+    int32_t *previous;
+    int hashBits;
+    size_t ringMask;
+} LzChains;
+
+static void lzInsert(LzChains *chains, const unsigned char *data, size_t pos) {
+    uint32_t hash = lzHash(data + pos, chains->hashBits);
+    chains->previous[pos & chains->ringMask] = chains->head[hash];
+    chains->head[hash] = (int32_t)pos;
+}
+
+// Longest match for data[pos..] among the chain entries, searched before pos
+// itself is inserted. Returns its length (0 if under LZ_MIN_MATCH).
+static size_t lzFindMatch(const LzChains *chains, const unsigned char *data, size_t pos, size_t size,
+                          const LzLevel *level, size_t *distance) {
+    size_t best = 0;
+    size_t limit = size - pos;
+    int32_t candidate = chains->head[lzHash(data + pos, chains->hashBits)];
+    for (int tries = level->chainDepth; candidate >= 0 && tries > 0; tries--) {
+        size_t back = pos - (size_t)candidate;
+        if (back >= LZ_WINDOW) break;
+        // Cheap reject: a longer match must agree at the current best length
+        if (data[candidate + best] == data[pos + best]) {
+            size_t length = matchLength(data + candidate, data + pos, limit);
+            if (length > best) {
+                best = length;
+                *distance = back;
+                if (length >= (size_t)level->niceLength || length == limit) break;
+            }
+        }
+        // Ring slots are reused after LZ_WINDOW positions, so a link that
+        // does not lead further back is stale
+        int32_t older = chains->previous[candidate & chains->ringMask];
+        if (older >= candidate) break;
+        candidate = older;
+    }
+    return best >= LZ_MIN_MATCH ? best : 0;
+}
+
+// Append a count that may not fit its nibble: 255 per full step, then the rest
+static void writeExtraLength(unsigned char **extra, size_t value) {
+    while (value >= 255) {
+        *(*extra)++ = 255;
+        value -= 255;
+    }
+    *(*extra)++ = (unsigned char)value;
+}
+
+static bool readExtraLength(const unsigned char **extra, const unsigned char *end, size_t *value) {
+    unsigned char byte;
+    do {
+        if (*extra == end) return false;
+        byte = *(*extra)++;
+        *value += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Emit one sequence: literals data[anchor..pos) then, unless length is 0, a
+// match of length bytes distance back
+static void lzEmit(unsigned char *streams[LZ_STREAMS], const unsigned char *data, size_t anchor, size_t pos,
+                   size_t length, size_t distance) {
+    size_t literals = pos - anchor;
+    size_t matchCode = length ? length - LZ_MIN_MATCH : 0;
+    *streams[LZ_TOKENS]++ = (unsigned char)((literals < 15 ? literals : 15) << 4 | (matchCode < 15 ? matchCode : 15));
+    if (literals >= 15) writeExtraLength(&streams[LZ_EXTRA], literals - 15);
+    memcpy(streams[LZ_LITERALS], data + anchor, literals);
+    streams[LZ_LITERALS] += literals;
+    if (length == 0) return;
+    *streams[LZ_OFFSET_LOW]++ = (unsigned char)distance;
+    *streams[LZ_OFFSET_HIGH]++ = (unsigned char)(distance >> 8);
+    if (matchCode >= 15) writeExtraLength(&streams[LZ_EXTRA], matchCode - 15);
+}
+
+// LZ77 block: BLOCK_LZ77, uint32 sequence count, then for each LzStream its
+// uint32 size, uint32 encoded size and Huffman block. Every sequence but the
+// last ends in a match; the last carries the trailing literals. Sets
+// job->outputSize to 0 if the block could not be encoded this way.
+static void encodeLzBlock(BlockJob *job) {
+    const unsigned char *data = job->input;
+    size_t size = job->inputSize;
+    const LzLevel *level = &lzLevels[job->level];
+
+    LzChains chains;
+    chains.hashBits = 8;
+    while (chains.hashBits < LZ_HASH_BITS && ((size_t)1 << chains.hashBits) < size) chains.hashBits++;
+    size_t ring = 1;
+    while (ring < size && ring < LZ_WINDOW) ring <<= 1;
+    chains.ringMask = ring - 1;
+    chains.head = (int32_t *)malloc(((size_t)1 << chains.hashBits) * sizeof(int32_t));
+    chains.previous = (int32_t *)malloc(ring * sizeof(int32_t));
+    memset(chains.head, 0xff, ((size_t)1 << chains.hashBits) * sizeof(int32_t));
+
+    // Every stream fits in size + 16 bytes: tokens and offsets take one byte
+    // per match of 4+ bytes, extras at most one per 255 plus two per sequence
+    unsigned char *buffers[LZ_STREAMS], *streams[LZ_STREAMS];
+    for (int k = 0; k < LZ_STREAMS; k++) {
+        buffers[k] = streams[k] = (unsigned char *)malloc(size + 16);
+    }
+
+    uint32_t sequenceCount = 1;
+    size_t pos = 0, anchor = 0;
+    while (pos + LZ_MIN_MATCH <= size) {
+        size_t distance = 0;
+        size_t length = lzFindMatch(&chains, data, pos, size, level, &distance);
+        lzInsert(&chains, data, pos);
+        if (length == 0) {
+            pos++;
+            continue;
+        }
+        // Lazy matching: a longer match one byte later wins over this one
+        while (length < (size_t)level->lazyLength && pos + 1 + LZ_MIN_MATCH <= size) {
+            size_t nextDistance = 0;
+            size_t nextLength = lzFindMatch(&chains, data, pos + 1, size, level, &nextDistance);
+            if (nextLength <= length) break;
+            pos++;
+            lzInsert(&chains, data, pos);
+            length = nextLength;
+            distance = nextDistance;
+        }
+
+        lzEmit(streams, data, anchor, pos, length, distance);
+        sequenceCount++;
+        size_t end = pos + length;
+        for (pos++; pos < end && pos + LZ_MIN_MATCH <= size; pos++) {
+            lzInsert(&chains, data, pos);
+        }
+        pos = end;
+        anchor = end;
+    }
+    lzEmit(streams, data, anchor, size, 0, 0);
+    free(chains.head);
+    free(chains.previous);
+
+    // Huffman code each stream as its own block
+    BlockJob parts[LZ_STREAMS];
+    size_t total = 1 + sizeof(uint32_t);
+    for (int k = 0; k < LZ_STREAMS; k++) {
+        parts[k] = (BlockJob){buffers[k], (size_t)(streams[k] - buffers[k]), 0, NULL, 0, 0, job->streamCount, 0, false};
+        encodeHuffmanBlock(&parts[k]);
+        total += 2 * sizeof(uint32_t) + parts[k].outputSize;
+    }
+    if (!reserveOutput(job, total)) {
+        for (int k = 0; k < LZ_STREAMS; k++) {
+            free(parts[k].output);
+            free(buffers[k]);
+        }
+        return;
+    }
+    unsigned char *out = job->output;
+    *out++ = BLOCK_LZ77;
+    memcpy(out, &sequenceCount, sizeof(sequenceCount));
+    out += sizeof(sequenceCount);
+    for (int k = 0; k < LZ_STREAMS; k++) {
+        uint32_t sizes[2] = {(uint32_t)parts[k].inputSize, (uint32_t)parts[k].outputSize};
+        memcpy(out, sizes, sizeof(sizes));
+        out += sizeof(sizes);
+        memcpy(out, parts[k].output, parts[k].outputSize);
+        out += parts[k].outputSize;
+        free(parts[k].output);
+        free(buffers[k]);
+    }
+    job->outputSize = total;
+}
+
+// Decode an LZ77 block (see encodeLzBlock) into job->output, checking every
+// count and distance against the streams and the original size
+static void decodeLzBlock(BlockJob *job) {
+    size_t expected = job->outputSize;
+    const unsigned char *in = job->input + 1;
+    const unsigned char *inEnd = job->input + job->inputSize;
+    uint32_t sequenceCount;
+    job->failed = true;
+    if ((size_t)(inEnd - in) < sizeof(sequenceCount)) return;
+    memcpy(&sequenceCount, in, sizeof(sequenceCount));
+    in += sizeof(sequenceCount);
+    if (sequenceCount == 0 || sequenceCount > expected / LZ_MIN_MATCH + 1) return;
+
+    BlockJob parts[LZ_STREAMS] = {{0}};
+    bool ok = true;
+    for (int k = 0; k < LZ_STREAMS && ok; k++) {
+        uint32_t sizes[2];
+        ok = (size_t)(inEnd - in) >= sizeof(sizes);
+        if (!ok) break;
+        memcpy(sizes, in, sizeof(sizes));
+        in += sizeof(sizes);
+        ok = sizes[0] <= expected + 16 && sizes[1] <= (size_t)(inEnd - in);
+        if (!ok) break;
+        parts[k].input = (unsigned char *)in;
+        parts[k].inputSize = sizes[1];
+        parts[k].outputSize = sizes[0];
+        decodeHuffmanBlock(&parts[k]);
+        ok = !parts[k].failed;
+        in += sizes[1];
+    }
+    ok = ok && in == inEnd && parts[LZ_TOKENS].outputSize == sequenceCount &&
+         parts[LZ_OFFSET_LOW].outputSize == sequenceCount - 1 && parts[LZ_OFFSET_HIGH].outputSize == sequenceCount - 1;
+
+    // Matches add at most 19 bytes per sequence plus 255 per extra length
+    // byte, so a larger original size comes from a damaged header
+    size_t literalCount = parts[LZ_LITERALS].outputSize;
+    ok = ok && literalCount <= expected &&
+         (expected - literalCount) / 255 <= parts[LZ_EXTRA].outputSize + sequenceCount;
+    if (ok && !reserveOutput(job, expected > 0 ? expected : 1)) ok = false;
+    if (ok) {
+        unsigned char *out = job->output;
+        const unsigned char *literals = parts[LZ_LITERALS].output;
+        const unsigned char *literalsEnd = literals + parts[LZ_LITERALS].outputSize;
+        const unsigned char *extra = parts[LZ_EXTRA].output;
+        const unsigned char *extraEnd = extra + parts[LZ_EXTRA].outputSize;
+        size_t pos = 0;
+        for (uint32_t seq = 0; seq < sequenceCount && ok; seq++) {
+            unsigned char token = parts[LZ_TOKENS].output[seq];
+            size_t literalCount = token >> 4;
+            if (literalCount == 15 && !readExtraLength(&extra, extraEnd, &literalCount)) ok = false;
+            if (!ok || literalCount > (size_t)(literalsEnd - literals) || literalCount > expected - pos) {
+                ok = false;
+                break;
+            }
+            memcpy(out + pos, literals, literalCount);
+            literals += literalCount;
+            pos += literalCount;
+            if (seq == sequenceCount - 1) break;
+
+            size_t length = token & 15;
+            if (length == 15 && !readExtraLength(&extra, extraEnd, &length)) ok = false;
+            length += LZ_MIN_MATCH;
+            size_t distance = parts[LZ_OFFSET_LOW].output[seq] | (size_t)parts[LZ_OFFSET_HIGH].output[seq] << 8;
+            if (!ok || distance == 0 || distance > pos || length > expected - pos) {
+                ok = false;
+                break;
+            }
+            if (distance >= length) {
+                memcpy(out + pos, out + pos - distance, length);
+            } else {
+                // Overlapping copy repeats the last distance bytes
+                for (size_t i = 0; i < length; i++) {
+                    out[pos + i] = out[pos - distance + i];
+                }
+            }
+            pos += length;
+        }
+        ok = ok && pos == expected && literals == literalsEnd && extra == extraEnd;
+    }
+    for (int k = 0; k < LZ_STREAMS; k++) {
+        free(parts[k].output);
+    }
+    job->failed = !ok;
+}
+
+// Encode job->input into job->output. Level 0 Huffman codes the bytes
+// directly. Higher levels also try an LZ77 block and keep whichever is
+// smaller, so incompressible data costs no more than before.
+void encodeBlock(BlockJob *job) {
+    encodeHuffmanBlock(job);
+    // Chain positions are int32_t, so huge blocks stay Huffman only
+    if (job->level <= 0 || job->inputSize < LZ_MIN_BLOCK || job->inputSize > INT32_MAX) return;
+
+    BlockJob lz = *job;
+    lz.output = NULL;
+    lz.outputCapacity = 0;
+    encodeLzBlock(&lz);
+    if (!lz.failed && lz.outputSize < job->outputSize) {
+        free(job->output);
+        job->output = lz.output;
+        job->outputSize = lz.outputSize;
+        job->outputCapacity = lz.outputCapacity;
+    } else {
+        free(lz.output);
+    }
+}
+
+// Decode job->input (one encoded block) into job->output. outputSize must
+// hold the block's original size on entry. Sets failed if the block is malformed.
+void decodeBlock(BlockJob *job) {
+    if (job->inputSize > 0 && job->input[0] == BLOCK_LZ77) {
+        decodeLzBlock(job);
+    } else {
+        decodeHuffmanBlock(job);
+    }
+}
+
+static void blockWorker(void *arg, int worker) {
+    (void)worker;
+    BlockRound *round = (BlockRound *)arg;
+    while (true) {
+        pthread_mutex_lock(&round->lock);
+        int index = round->nextJob++;
+        pthread_mutex_unlock(&round->lock);
+        if (index >= round->jobCount) break;
+        round->process(&round->jobs[index]);
+    }
+}
+
+static void runBlockRound(ThreadPool *pool, BlockRound *round, int jobCount, void (*process)(BlockJob *job)) {
+    round->jobCount = jobCount;
+    round->nextJob = 0;
+    round->process = process;
+    threadPoolRun(pool, blockWorker, round);
+}
+
+// Fill up to roundSize jobs with the next blocks of inputFile; returns how many
+static int readBlockRound(FILE *inputFile, BlockJob *jobs, int roundSize, size_t blockSize) {
+    int jobCount = 0;
+    while (jobCount < roundSize) {
+        BlockJob *job = &jobs[jobCount];
+        if (job->inputCapacity < blockSize) {
+            job->input = (unsigned char *)realloc(job->input, blockSize);
+            job->inputCapacity = blockSize;
+        }
+        job->inputSize = fread(job->input, 1, blockSize, inputFile);
+        if (job->inputSize == 0) break;
+        jobCount++;
+    }
+    return jobCount;
+}
+
+static void freeBlockJobs(BlockJob *jobs, int jobCount) {
+    for (int i = 0; i < jobCount; i++) {
+        free(jobs[i].input);
+        free(jobs[i].output);
+    }
+    free(jobs);
+}
+
+// Block container: "HUFB", uint32 version, uint32 block size, then the
+// encoded blocks back to back, then one BlockIndexEntry per block and a
+// trailer of uint32 block count, uint64 index offset and "HUFI". Blocks are
+// independent, so both directions run a round of blocks per pool dispatch.
+bool compressBlocks(const char *inputFilePath, const char *outputFilePath, size_t blockSize, int streamCount,
+                    int level, int threadCount) {
+    FILE *inputFile = fopen(inputFilePath, "rb");
+    if (!inputFile) {
+        printf(RED "Error opening input file: %s\n" RESET, inputFilePath);
+        return false;
+    }
+    FILE *outputFile = fopen(outputFilePath, "wb");
+    if (!outputFile) {
+        printf(RED "Error opening output file: %s\n" RESET, outputFilePath);
+        fclose(inputFile);
+        return false;
+    }
+
+    double start = nowSeconds();
+    ThreadPool *pool = createThreadPool(threadCount);
+    int roundSize = pool->workerCount * BLOCKS_PER_WORKER;
+    BlockJob *jobs = (BlockJob *)calloc(roundSize, sizeof(BlockJob));
+    BlockRound round = {jobs, 0, 0, PTHREAD_MUTEX_INITIALIZER, NULL};
+    for (int i = 0; i < roundSize; i++) {
+        jobs[i].streamCount = streamCount;
+        jobs[i].level = level;
+    }
+
+    uint32_t header[2] = {BLOCK_VERSION, (uint32_t)blockSize};
+    bool ok = fwrite(BLOCK_MAGIC, 1, 4, outputFile) == 4 && fwrite(header, sizeof(uint32_t), 2, outputFile) == 2;
+    uint64_t offset = 4 + sizeof(header);
+    uint64_t inputTotal = 0;
+    BlockIndexEntry *index = NULL;
+    uint32_t blockCount = 0, indexCapacity = 0;
+
+    while (ok) {
+        int jobCount = readBlockRound(inputFile, jobs, roundSize, blockSize);
+        if (jobCount == 0) break;
+
+        runBlockRound(pool, &round, jobCount, encodeBlock);
+
+        for (int i = 0; i < jobCount && ok; i++) {
+            if (blockCount == indexCapacity) {
+                indexCapacity = indexCapacity ? indexCapacity * 2 : 64;
+                index = (BlockIndexEntry *)realloc(index, indexCapacity * sizeof(BlockIndexEntry));
+            }
+            index[blockCount].offset = offset;
+            index[blockCount].encodedSize = (uint32_t)jobs[i].outputSize;
+            index[blockCount].originalSize = (uint32_t)jobs[i].inputSize;
+            blockCount++;
+            ok = !jobs[i].failed && fwrite(jobs[i].output, 1, jobs[i].outputSize, outputFile) == jobs[i].outputSize;
+            offset += jobs[i].outputSize;
+            inputTotal += jobs[i].inputSize;
+        }
+    }
+    if (ferror(inputFile)) ok = false;
+
+    ok = ok && (blockCount == 0 || fwrite(index, sizeof(BlockIndexEntry), blockCount, outputFile) == blockCount);
+    ok = ok && fwrite(&blockCount, sizeof(uint32_t), 1, outputFile) == 1;
+    ok = ok && fwrite(&offset, sizeof(uint64_t), 1, outputFile) == 1;
+    ok = ok && fwrite(INDEX_MAGIC, 1, 4, outputFile) == 4;
+    if (fclose(outputFile) != 0) ok = false;
+    fclose(inputFile);
+
+    if (ok) {
+        double elapsed = nowSeconds() - start;
+        printf(GREEN "Compressed %u block(s) on %d thread(s) in %.3f s (%.1f MB/s)\n" RESET, blockCount,
+               pool->workerCount, elapsed, elapsed > 0 ? inputTotal / elapsed / 1e6 : 0.0);
+    } else {
+        printf(RED "Error writing compressed file: %s\n" RESET, outputFilePath);
+    }
+    free(index);
+    freeBlockJobs(jobs, roundSize);
+    freeThreadPool(pool);
+    return ok;
+}
+
+// Decode a block container whose magic has already been read from inputFile
+bool decompressBlocks(FILE *inputFile, const char *outputFilePath, int threadCount) {
+    uint32_t header[2];
+    uint32_t blockCount;
+    uint64_t indexOffset;
+    char magic[4];
+    if (fread(header, sizeof(uint32_t), 2, inputFile) != 2 || header[0] < BLOCK_MIN_VERSION ||
+        header[0] > BLOCK_VERSION ||
+        fseek(inputFile, -16, SEEK_END) != 0 || fread(&blockCount, sizeof(uint32_t), 1, inputFile) != 1 ||
+        fread(&indexOffset, sizeof(uint64_t), 1, inputFile) != 1 || fread(magic, 1, 4, inputFile) != 4 ||
+        memcmp(magic, INDEX_MAGIC, 4) != 0) {
+        printf(RED "Compressed file has a damaged block header or index\n" RESET);
+        return false;
+    }
+
+    // The index sits between the blocks and the 16-byte trailer, so the
+    // count and offset must account for the file size exactly
+    uint64_t fileSize = (uint64_t)ftell(inputFile);
+    uint64_t indexSize = (uint64_t)blockCount * sizeof(BlockIndexEntry);
+    if (indexOffset > fileSize || fileSize - indexOffset != indexSize + 16) {
+        printf(RED "Compressed file has a damaged block index\n" RESET);
+        return false;
+    }
+    BlockIndexEntry *index = (BlockIndexEntry *)malloc((blockCount ? blockCount : 1) * sizeof(BlockIndexEntry));
+    if (!index) {
+        printf(RED "Not enough memory for the block index\n" RESET);
+        return false;
+    }
+    if (fseek(inputFile, (long)indexOffset, SEEK_SET) != 0 ||
+        fread(index, sizeof(BlockIndexEntry), blockCount, inputFile) != blockCount) {
+        printf(RED "Compressed file has a damaged block index\n" RESET);
+        free(index);
+        return false;
+    }
+    for (uint32_t b = 0; b < blockCount; b++) {
+        if (index[b].originalSize > header[1] || index[b].offset > indexOffset ||
+            index[b].encodedSize > indexOffset - index[b].offset) {
+            printf(RED "Compressed file has a damaged block index\n" RESET);
+            free(index);
+            return false;
+        }
+    }
+
+    FILE *outputFile = fopen(outputFilePath, "wb");
+    if (!outputFile) {
+        printf(RED "Error opening output file for decompression: %s\n" RESET, outputFilePath);
+        free(index);
+        return false;
+    }
+
+    double start = nowSeconds();
+    ThreadPool *pool = createThreadPool(threadCount);
+    int roundSize = pool->workerCount * BLOCKS_PER_WORKER;
+    BlockJob *jobs = (BlockJob *)calloc(roundSize, sizeof(BlockJob));
+    BlockRound round = {jobs, 0, 0, PTHREAD_MUTEX_INITIALIZER, NULL};
+    uint64_t outputTotal = 0;
+    bool ok = true;
+
+    for (uint32_t first = 0; first < blockCount && ok; first += roundSize) {
+        int jobCount = blockCount - first < (uint32_t)roundSize ? (int)(blockCount - first) : roundSize;
+        for (int i = 0; i < jobCount && ok; i++) {
+            BlockJob *job = &jobs[i];
+            const BlockIndexEntry *entry = &index[first + i];
+            if (job->inputCapacity < entry->encodedSize) {
+                job->input = (unsigned char *)realloc(job->input, entry->encodedSize);
+                job->inputCapacity = entry->encodedSize;
+            }
+            job->inputSize = entry->encodedSize;
+            job->outputSize = entry->originalSize;
+            ok = fseek(inputFile, (long)entry->offset, SEEK_SET) == 0 &&
+                 fread(job->input, 1, job->inputSize, inputFile) == job->inputSize;
+        }
+        if (!ok) break;
+
+        runBlockRound(pool, &round, jobCount, decodeBlock);
+
+        for (int i = 0; i < jobCount && ok; i++) {
+            ok = !jobs[i].failed && fwrite(jobs[i].output, 1, jobs[i].outputSize, outputFile) == jobs[i].outputSize;
+            outputTotal += jobs[i].outputSize;
+        }
+    }
+    if (fclose(outputFile) != 0) ok = false;
+
+    if (ok) {
+        double elapsed = nowSeconds() - start;
+        printf(GREEN "Decompressed %u block(s) on %d thread(s) in %.3f s (%.1f MB/s)\n" RESET, blockCount,
+               pool->workerCount, elapsed, elapsed > 0 ? outputTotal / elapsed / 1e6 : 0.0);
+    } else {
+        printf(RED "Compressed file is damaged or could not be written: %s\n" RESET, outputFilePath);
+    }
+    free(index);
+    freeBlockJobs(jobs, roundSize);
+    freeThreadPool(pool);
+    return ok;
+}
+
+// Block stream: "HUFS", uint32 version, uint32 block size, then for each
+// block uint32 original size, uint32 encoded size and the encoded bytes,
+// ending with a block whose sizes are both 0. Nothing is seeked, so input and
+// output may be pipes; memory stays at one round of blocks. Errors go to
+// stderr because the output may be stdout.
+bool compressStream(FILE *inputFile, FILE *outputFile, size_t blockSize, int streamCount, int level,
+                    int threadCount) {
+    ThreadPool *pool = createThreadPool(threadCount);
+    int roundSize = pool->workerCount * BLOCKS_PER_WORKER;
+    BlockJob *jobs = (BlockJob *)calloc(roundSize, sizeof(BlockJob));
+    BlockRound round = {jobs, 0, 0, PTHREAD_MUTEX_INITIALIZER, NULL};
+    for (int i = 0; i < roundSize; i++) {
+        jobs[i].streamCount = streamCount;
+        jobs[i].level = level;
+    }
+
+    uint32_t header[2] = {BLOCK_VERSION, (uint32_t)blockSize};
+    bool ok = fwrite(STREAM_MAGIC, 1, 4, outputFile) == 4 && fwrite(header, sizeof(uint32_t), 2, outputFile) == 2;
+    while (ok) {
+        int jobCount = readBlockRound(inputFile, jobs, roundSize, blockSize);
+        if (jobCount == 0) break;
+
+        runBlockRound(pool, &round, jobCount, encodeBlock);
+
+        for (int i = 0; i < jobCount && ok; i++) {
+            uint32_t sizes[2] = {(uint32_t)jobs[i].inputSize, (uint32_t)jobs[i].outputSize};
+            ok = !jobs[i].failed && fwrite(sizes, sizeof(uint32_t), 2, outputFile) == 2 &&
+                 fwrite(jobs[i].output, 1, jobs[i].outputSize, outputFile) == jobs[i].outputSize;
+        }
+        // Hand each round downstream instead of waiting for stdio's buffer
+        ok = ok && fflush(outputFile) == 0;
+    }
+    if (ferror(inputFile)) {
+        fprintf(stderr, RED "Error reading input stream\n" RESET);
+        ok = false;
+    }
+
+    uint32_t end[2] = {0, 0};
+    ok = ok && fwrite(end, sizeof(uint32_t), 2, outputFile) == 2 && fflush(outputFile) == 0;
+    if (!ok) fprintf(stderr, RED "Error writing compressed stream\n" RESET);
+    freeBlockJobs(jobs, roundSize);
+    freeThreadPool(pool);
+    return ok;
+}
+
+// Decode a block stream whose magic has already been read from inputFile
+bool decompressStream(FILE *inputFile, FILE *outputFile, int threadCount) {
+    uint32_t header[2];
+    if (fread(header, sizeof(uint32_t), 2, inputFile) != 2 || header[0] < BLOCK_MIN_VERSION ||
+        header[0] > BLOCK_VERSION || header[1] == 0) {
+        fprintf(stderr, RED "Compressed stream has a damaged header\n" RESET);
+        return false;
+    }
+    // Largest encoding of a full block: the stream count, the lengths, the
+    // stream sizes, then every byte at the longest code length plus padding
+    size_t maxEncoded = 1 + MAX_CHAR + (INTERLEAVED_STREAMS - 1) * sizeof(uint32_t) +
+                        ((size_t)header[1] * MAX_CODE_LENGTH + 7) / 8 + INTERLEAVED_STREAMS;
+
+    ThreadPool *pool = createThreadPool(threadCount);
+    int roundSize = pool->workerCount * BLOCKS_PER_WORKER;
+    BlockJob *jobs = (BlockJob *)calloc(roundSize, sizeof(BlockJob));
+    BlockRound round = {jobs, 0, 0, PTHREAD_MUTEX_INITIALIZER, NULL};
+    bool ok = true, finished = false, writeFailed = false;
+
+    while (ok && !finished) {
+        int jobCount = 0;
+        while (jobCount < roundSize) {
+            BlockJob *job = &jobs[jobCount];
+            uint32_t sizes[2];
+            if (fread(sizes, sizeof(uint32_t), 2, inputFile) != 2 || sizes[0] > header[1] || sizes[1] > maxEncoded) {
+                ok = false;
+                break;
+            }
+            if (sizes[0] == 0 && sizes[1] == 0) {
+                finished = true;
+                break;
+            }
+            if (job->inputCapacity < sizes[1]) {
+                job->input = (unsigned char *)realloc(job->input, sizes[1]);
+                job->inputCapacity = sizes[1];
+            }
+            job->inputSize = sizes[1];
+            job->outputSize = sizes[0];
+            if (fread(job->input, 1, job->inputSize, inputFile) != job->inputSize) {
+                ok = false;
+                break;
+            }
+            jobCount++;
+        }
+
+        runBlockRound(pool, &round, jobCount, decodeBlock);
+
+        for (int i = 0; i < jobCount; i++) {
+            if (jobs[i].failed) {
+                ok = false;
+                break;
+            }
+            if (fwrite(jobs[i].output, 1, jobs[i].outputSize, outputFile) != jobs[i].outputSize) {
+                writeFailed = true;
+                break;
+            }
+        }
+        if (writeFailed || fflush(outputFile) != 0) {
+            fprintf(stderr, RED "Error writing decompressed stream\n" RESET);
+            writeFailed = true;
+            break;
+        }
+    }
+    if (!ok) fprintf(stderr, RED "Compressed stream is truncated or damaged\n" RESET);
+    ok = ok && !writeFailed;
+    freeBlockJobs(jobs, roundSize);
+    freeThreadPool(pool);
+    return ok;
+}
+
+// Non-interactive mode:
+//   q2 --compress [--stream] [--interleave] [--level 0-9] [--threads N] [--block-size BYTES] <input> <output>
+//   q2 --decompress [--threads N] <input> <output>
+// --compress writes the block container, or the block stream with --stream;
+// --interleave splits each block into INTERLEAVED_STREAMS bitstreams; --level
+// picks the LZ77 effort (0 for Huffman only, DEFAULT_LEVEL by default).
+// --decompress reads any format. With --stream, or when decompressing a
+// stream, either path may be "-" for stdin/stdout.
+int runCommandLine(int argc, char **argv) {
+    const char *usage = "Usage: %s --compress [--stream] [--interleave] [--level 0-9] [--threads N] [--block-size BYTES]"
+                        " <input> <output>\n"
+                        "       %s --decompress [--threads N] <input> <output>\n"
+                        "       %s --bench [--bytes N] [--no-simd] [file...]\n"
+                        "With --stream, or when decompressing a stream, \"-\" means stdin/stdout.\n";
+    if (strcmp(argv[1], "--bench") == 0) return runBenchmarkMode(argc, argv);
+    bool compressing = strcmp(argv[1], "--compress") == 0;
+    if (!compressing && strcmp(argv[1], "--decompress") != 0) {
+        fprintf(stderr, usage, argv[0], argv[0], argv[0]);
+        return 1;
+    }
+
+    int threadCount = availableCores();
+    long blockSize = DEFAULT_BLOCK_SIZE;
+    bool streaming = false;
+    int streamCount = 1;
+    int level = DEFAULT_LEVEL;
+    const char *paths[2];
+    int pathCount = 0;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--block-size") == 0 && i + 1 < argc && compressing) {
+            blockSize = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--stream") == 0 && compressing) {
+            streaming = true;
+        } else if (strcmp(argv[i], "--interleave") == 0 && compressing) {
+            streamCount = INTERLEAVED_STREAMS;
+        } else if (strcmp(argv[i], "--level") == 0 && i + 1 < argc && compressing) {
+            level = atoi(argv[++i]);
+        } else if (pathCount < 2) {
+            paths[pathCount++] = argv[i];
+        } else {
+            pathCount = 3;
+        }
+    }
+    if (pathCount != 2 || threadCount < 1 || blockSize < 1 || blockSize > UINT32_MAX || level < 0 ||
+        level > MAX_LEVEL) {
+        fprintf(stderr, usage, argv[0], argv[0], argv[0]);
+        return 1;
+    }
+    if (threadCount > MAX_WORKER_THREADS) threadCount = MAX_WORKER_THREADS;
+    bool standardInput = strcmp(paths[0], "-") == 0;
+    bool standardOutput = strcmp(paths[1], "-") == 0;
+
+    if (compressing && !streaming) {
+        if (standardInput || standardOutput) {
+            fprintf(stderr, RED "Use --stream to compress from stdin or to stdout\n" RESET);
+            return 1;
+        }
+        return compressBlocks(paths[0], paths[1], (size_t)blockSize, streamCount, level, threadCount) ? 0 : 1;
+    }
+
+    FILE *inputFile = standardInput ? stdin : fopen(paths[0], "rb");
+    if (!inputFile) {
+        fprintf(stderr, RED "Error opening %s file: %s\n" RESET, compressing ? "input" : "compressed", paths[0]);
+        return 1;
+    }
+    char magic[4];
+    if (!compressing) {
+        bool hasMagic = fread(magic, 1, 4, inputFile) == 4;
+        if (!hasMagic || memcmp(magic, STREAM_MAGIC, 4) != 0) {
+            // The other formats are read with seeks, from named files only
+            if (standardInput || standardOutput) {
+                fprintf(stderr, RED "Only streams made with --stream can be read from stdin or written to stdout\n" RESET);
+                if (inputFile != stdin) fclose(inputFile);
+                return 1;
+            }
+            if (hasMagic && memcmp(magic, BLOCK_MAGIC, 4) == 0) {
+                bool ok = decompressBlocks(inputFile, paths[1], threadCount);
+                fclose(inputFile);
+                return ok ? 0 : 1;
+            }
+            // Single-stream formats have no parallel decoder
+            fclose(inputFile);
+            return decompress(paths[0], paths[1]) ? 0 : 1;
+        }
+    }
+
+    FILE *outputFile = standardOutput ? stdout : fopen(paths[1], "wb");
+    if (!outputFile) {
+        fprintf(stderr, RED "Error opening output file: %s\n" RESET, paths[1]);
+        if (inputFile != stdin) fclose(inputFile);
+        return 1;
+    }
+    bool ok = compressing ? compressStream(inputFile, outputFile, (size_t)blockSize, streamCount, level, threadCount)
+                          : decompressStream(inputFile, outputFile, threadCount);
+    if (inputFile != stdin) fclose(inputFile);
+    if (outputFile != stdout && fclose(outputFile) != 0) ok = false;
+    return ok ? 0 : 1;
+}
+
+// Fill data with a seeded sample: "text" draws words from a small vocabulary
+// with a skewed distribution, "binary" is uniform random bytes, and
+// "repetitive" is long runs of a few byte values
+static void fillBenchInput(const char *kind, unsigned char *data, size_t size) {
+    static const char *words[] = {"the", "of", "and", "a", "to", "in", "is", "request", "error", "user",
+                                  "GET", "200", "session", "timeout", "cache", "node", "huffman", "block"};
+    uint64_t state = 88172645463325252ull;
+    size_t i = 0;
+    while (i < size) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        if (strcmp(kind, "binary") == 0) {
+            for (int k = 0; k < 8 && i < size; k++) {
+                data[i++] = (unsigned char)(state >> (8 * k));
+            }
+        } else if (strcmp(kind, "repetitive") == 0) {
+            size_t run = 64 + state % 4096;
+            unsigned char value = "\0 \n\xff"[(state >> 32) & 3];
+            for (size_t k = 0; k < run && i < size; k++) {
+                data[i++] = value;
+            }
+        } else {
+            // Squaring a uniform draw favours the first words
+            unsigned pick = (unsigned)((state % 1000) * (state % 1000) / 1000000.0 * 18);
+            const char *word = words[pick];
+            for (int k = 0; word[k] && i < size; k++) {
+                data[i++] = (unsigned char)word[k];
+            }
+            if (i < size) data[i++] = (state >> 40) % 12 == 0 ? '\n' : ' ';
+        }
+    }
+}
+
+// Best of BENCH_RUNS, in seconds
+static double timeHistogram(HistogramKernel kernel, const unsigned char *data, size_t size,
+                            unsigned frequency[MAX_CHAR]) {
+    double best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        memset(frequency, 0, MAX_CHAR * sizeof(unsigned));
+        double start = nowSeconds();
+        kernel(data, size, frequency);
+        double elapsed = nowSeconds() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+// The original frequency pass: one fgetc per byte from a file
+static double timeFgetcLoop(const unsigned char *data, size_t size, unsigned frequency[MAX_CHAR]) {
+    FILE *file = tmpfile();
+    if (!file || fwrite(data, 1, size, file) != size) {
+        if (file) fclose(file);
+        return -1;
+    }
+    double best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        memset(frequency, 0, MAX_CHAR * sizeof(unsigned));
+        rewind(file);
+        double start = nowSeconds();
+        int c;
+        while ((c = fgetc(file)) != EOF) {
+            frequency[(unsigned char)c]++;
+        }
+        double elapsed = nowSeconds() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
+    }
+    fclose(file);
+    return best;
+}
+
+// Benchmark the frequency pass on generated text, binary and repetitive
+// inputs, or on the given files. Every method is checked against the
+// single-table count; the exit status is non-zero on any mismatch.
+int runBenchmarkMode(int argc, char **argv) {
+    const char *usage = "Usage: %s --bench [--bytes N] [--no-simd] [file...]\n";
+    long long byteCount = BENCH_DEFAULT_BYTES;
+    bool allowSimd = true;
+    const char *files[64];
+    int fileCount = 0;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--bytes") == 0 && i + 1 < argc) {
+            byteCount = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--no-simd") == 0) {
+            allowSimd = false;
+        } else if (argv[i][0] != '-' && fileCount < 64) {
+            files[fileCount++] = argv[i];
+        } else {
+            fprintf(stderr, usage, argv[0]);
+            return 1;
+        }
+    }
+    if (byteCount < 1) {
+        fprintf(stderr, usage, argv[0]);
+        return 1;
+    }
+
+    const char *simdName;
+    HistogramKernel simdKernel = selectHistogramKernel(allowSimd, &simdName);
+    const char *kinds[] = {"text", "binary", "repetitive"};
+    int inputCount = fileCount > 0 ? fileCount : 3;
+    int failures = 0;
+    printf("%-20s %12s  %-20s %10s %10s  %s\n", "input", "bytes", "method", "ms", "MB/s", "check");
+
+    for (int input = 0; input < inputCount; input++) {
+        const char *label;
+        unsigned char *data;
+        size_t size;
+        if (fileCount > 0) {
+            label = files[input];
+            FILE *file = fopen(label, "rb");
+            if (!file) {
+                fprintf(stderr, RED "Error opening input file: %s\n" RESET, label);
+                failures++;
+                continue;
+            }
+            data = readRemaining(file, &size);
+            fclose(file);
+        } else {
+            label = kinds[input];
+            size = (size_t)byteCount;
+            data = (unsigned char *)malloc(size);
+            fillBenchInput(label, data, size);
+        }
+
+        unsigned expected[MAX_CHAR] = {0};
+        countBytesSingle(data, size, expected);
+        struct {
+            const char *name;
+            HistogramKernel kernel;
+        } methods[] = {{"fgetc loop", NULL},
+                       {"one table", countBytesSingle},
+                       {"4 tables", countBytesInterleaved},
+                       {simdName, simdKernel}};
+        int methodCount = simdKernel == countBytesInterleaved ? 3 : 4;
+        for (int m = 0; m < methodCount; m++) {
+            unsigned frequency[MAX_CHAR];
+            double seconds = methods[m].kernel ? timeHistogram(methods[m].kernel, data, size, frequency)
+                                               : timeFgetcLoop(data, size, frequency);
+            bool match = seconds >= 0 && memcmp(frequency, expected, sizeof(expected)) == 0;
+            if (!match) failures++;
+            printf("%-20s %12zu  %-20s %10.2f %10.1f  %s\n", label, size, methods[m].name, seconds * 1e3,
+                   seconds > 0 ? size / seconds / 1e6 : 0.0, match ? "ok" : "MISMATCH");
+        }
+        free(data);
+    }
+    return failures > 0 ? 1 : 0;
+}